@@ -0,0 +1,496 @@
+#include "camera.h"
+#include "denoiser.h"
+#include "film.h"
+#include "geometry/box_geometry.h"
+#include "geometry/sphere_geometry.h"
+#include "integrator/path_state.h"
+#include "material/diffuse_material.h"
+#include "primitive.h"
+#include "random.h"
+#include "scene.h"
+#include "scenes/cornell_box.h"
+#include "scenes/procedural_scene.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Inputs are generated from a fixed seed, so every run measures exactly the same work.
+constexpr uint32_t INPUT_SEED = 1;
+
+// Number of rays, directions and such that a benchmark cycles through. Small enough to stay in the L1 cache, so
+// that the kernels rather than the memory are measured.
+constexpr int INPUT_COUNT = 1024;
+
+constexpr int DEFAULT_SAMPLE_COUNT = 20;
+
+// Every sample runs the kernel enough times to take at least this long.
+constexpr double SAMPLE_SECONDS = 0.05;
+
+constexpr int FILM_WIDTH = 1024;
+constexpr int FILM_HEIGHT = 1024;
+// Smaller than the film, a single pass of the denoiser already takes longer than a sample.
+constexpr int DENOISE_WIDTH = 256;
+constexpr int DENOISE_HEIGHT = 256;
+
+constexpr int DIFFUSE_BOUNCES_MAX = 4;
+constexpr int SPECULAR_BOUNCES_MAX = 4;
+
+// Results are accumulated here, so that the compiler can't drop the kernels as dead code.
+static volatile double g_sink;
+
+struct Benchmark {
+    std::string name;
+
+    // What the throughput is counted in and how many of those a single call of the kernel processes.
+    std::string item_name;
+    double items_per_op;
+
+    // Runs the kernel the given number of times.
+    std::function<void(int)> run;
+};
+
+struct Measurement {
+    double ns_per_op;
+
+    // Half-width of the 95% confidence interval of `ns_per_op`.
+    double ns_per_op_error;
+
+    int iterations;
+};
+
+struct Ray {
+    float3 origin;
+    float3 direction;
+};
+
+// Two-sided 95% quantiles of the Student's t-distribution for 1 to 30 degrees of freedom.
+static double student_t_95(int degrees_of_freedom) {
+    static constexpr double QUANTILES[] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+    };
+
+    assert(degrees_of_freedom > 0);
+
+    if (degrees_of_freedom <= static_cast<int>(std::size(QUANTILES))) {
+        return QUANTILES[degrees_of_freedom - 1];
+    }
+    return 1.96;
+}
+
+static double time_iterations(const Benchmark& benchmark, int iterations) {
+    auto start = std::chrono::steady_clock::now();
+    benchmark.run(iterations);
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static Measurement measure(const Benchmark& benchmark, int sample_count) {
+    assert(sample_count > 1);
+
+    // Doubling the iteration count until a sample is long enough also warms up the caches and the branch predictors.
+    int iterations = 1;
+    while (time_iterations(benchmark, iterations) < SAMPLE_SECONDS && iterations < (1 << 30)) {
+        iterations *= 2;
+    }
+
+    std::vector<double> samples(sample_count);
+    for (double& sample : samples) {
+        sample = time_iterations(benchmark, iterations) * 1e9 / iterations;
+    }
+
+    double mean = 0.0;
+    for (double sample : samples) {
+        mean += sample;
+    }
+    mean /= sample_count;
+
+    double variance = 0.0;
+    for (double sample : samples) {
+        variance += sqr(sample - mean);
+    }
+    variance /= sample_count - 1;
+
+    return Measurement{ mean, student_t_95(sample_count - 1) * std::sqrt(variance / sample_count), iterations };
+}
+
+static float3 random_direction(Random& random) {
+    float3 result = sample_hemisphere(random.rand2());
+    return random.rand() < 0.5 ? result : float3(result.x, result.y, -result.z);
+}
+
+// Rays from a sphere around `center` towards random points of a slightly larger box than `extent`, so that some of
+// them miss.
+static std::vector<Ray> generate_rays(Random& random, const float3& center, double extent) {
+    std::vector<Ray> result(INPUT_COUNT);
+
+    for (Ray& ray : result) {
+        float3 target = center + float3(random.rand() - 0.5, random.rand() - 0.5, random.rand() - 0.5) * (3.0 * extent);
+
+        ray.origin = center + random_direction(random) * (6.0 * extent);
+        ray.direction = normalize(target - ray.origin);
+    }
+
+    return result;
+}
+
+static std::vector<Ray> generate_camera_rays(Random& random, const Camera& camera) {
+    std::vector<Ray> result(INPUT_COUNT);
+
+    for (Ray& ray : result) {
+        ray.origin = camera.position();
+        ray.direction = camera.ray_direction(random.rand() * 2.0 - 1.0, random.rand() * 2.0 - 1.0);
+    }
+
+    return result;
+}
+
+// The loop of `PathTracerIntegrator::sample_ray`. Returns the sum of the red radiance of the paths.
+static double trace_paths(Random& random, const Scene& scene, const std::vector<Ray>& rays, int iterations) {
+    double result = 0.0;
+
+    for (int i = 0; i < iterations; i++) {
+        const Ray& ray = rays[i % INPUT_COUNT];
+
+        PathState state(ray.origin, ray.direction);
+        while (std::optional<SceneHit> hit = scene.raycast(state.origin, state.direction)) {
+            if (!sample_hit(random, state, scene, *hit, DIFFUSE_BOUNCES_MAX, SPECULAR_BOUNCES_MAX)) {
+                break;
+            }
+        }
+        result += state.radiance.x;
+    }
+
+    return result;
+}
+
+// Benchmarks of the procedural scene are only added if its options are given.
+static std::vector<Benchmark> build_benchmarks(const std::optional<ProceduralSceneOptions>& procedural) {
+    std::vector<Benchmark> result;
+
+    Random random(INPUT_SEED);
+
+    {
+        auto geometry = std::make_shared<BoxGeometry>(float3(0.5, 0.25, 0.75));
+        auto rays = std::make_shared<std::vector<Ray>>(generate_rays(random, float3(0.0), 0.75));
+
+        result.push_back(Benchmark{ "box_raycast", "rays", 1.0, [=](int iterations) {
+            double sum = 0.0;
+            for (int i = 0; i < iterations; i++) {
+                const Ray& ray = (*rays)[i % INPUT_COUNT];
+                if (std::optional<GeometryHit> hit = geometry->raycast(ray.origin, ray.direction, std::numeric_limits<double>::infinity())) {
+                    sum += hit->distance;
+                }
+            }
+            g_sink = sum;
+        } });
+    }
+
+    {
+        auto geometry = std::make_shared<SphereGeometry>(0.5);
+        auto rays = std::make_shared<std::vector<Ray>>(generate_rays(random, float3(0.0), 0.5));
+
+        result.push_back(Benchmark{ "sphere_raycast", "rays", 1.0, [=](int iterations) {
+            double sum = 0.0;
+            for (int i = 0; i < iterations; i++) {
+                const Ray& ray = (*rays)[i % INPUT_COUNT];
+                if (std::optional<GeometryHit> hit = geometry->raycast(ray.origin, ray.direction, std::numeric_limits<double>::infinity())) {
+                    sum += hit->distance;
+                }
+            }
+            g_sink = sum;
+        } });
+    }
+
+    {
+        // Same as a box of the Cornell box, the ray is transformed to the local space and the hit back.
+        float4x4 transform = float4x4::rotation(float3(0.0, 1.0, 0.0), radians(20.0)) * float4x4::translation(float3(0.175, -0.35, 2.3));
+        auto primitive = std::make_shared<Primitive>(std::make_shared<BoxGeometry>(float3(0.15)), std::make_shared<DiffuseMaterial>(float3(1.0)), transform);
+        auto rays = std::make_shared<std::vector<Ray>>(generate_rays(random, float3(0.175, -0.35, 2.3), 0.15));
+
+        result.push_back(Benchmark{ "primitive_raycast", "rays", 1.0, [=](int iterations) {
+            double sum = 0.0;
+            for (int i = 0; i < iterations; i++) {
+                const Ray& ray = (*rays)[i % INPUT_COUNT];
+                if (std::optional<GeometryHit> hit = primitive->geometry_raycast(ray.origin, ray.direction, std::numeric_limits<double>::infinity())) {
+                    sum += hit->distance;
+                }
+            }
+            g_sink = sum;
+        } });
+    }
+
+    {
+        auto material = std::make_shared<DiffuseMaterial>(float3(0.8, 0.6, 0.4));
+        auto outgoing = std::make_shared<std::vector<float3>>(INPUT_COUNT);
+        auto randoms = std::make_shared<std::vector<float2>>(INPUT_COUNT);
+        for (int i = 0; i < INPUT_COUNT; i++) {
+            (*outgoing)[i] = sample_hemisphere(random.rand2());
+            (*randoms)[i] = random.rand2();
+        }
+
+        result.push_back(Benchmark{ "diffuse_bsdf_sample", "samples", 1.0, [=](int iterations) {
+            double sum = 0.0;
+            for (int i = 0; i < iterations; i++) {
+                float3 ingoing;
+                double pdf;
+                float3 bsdf = material->bsdf(ingoing, (*outgoing)[i % INPUT_COUNT], pdf, (*randoms)[i % INPUT_COUNT]);
+                sum += bsdf.x + ingoing.z + pdf;
+            }
+            g_sink = sum;
+        } });
+
+        auto ingoing = std::make_shared<std::vector<float3>>(INPUT_COUNT);
+        for (float3& direction : *ingoing) {
+            direction = random_direction(random);
+        }
+
+        result.push_back(Benchmark{ "diffuse_bsdf_evaluate", "evaluations", 1.0, [=](int iterations) {
+            double sum = 0.0;
+            for (int i = 0; i < iterations; i++) {
+                double pdf;
+                float3 bsdf = material->bsdf((*ingoing)[i % INPUT_COUNT], (*outgoing)[i % INPUT_COUNT], pdf);
+                sum += bsdf.x + pdf;
+            }
+            g_sink = sum;
+        } });
+    }
+
+    {
+        auto film = std::make_shared<Film>(FILM_WIDTH, FILM_HEIGHT);
+        auto next_passes = std::make_shared<std::vector<int>>(static_cast<size_t>(film->tiles_x) * film->tiles_y, 0);
+
+        auto samples = std::make_shared<std::vector<float3>>(TILE_SIZE * TILE_SIZE);
+        for (float3& sample : *samples) {
+            sample = float3(random.rand(), random.rand(), random.rand());
+        }
+
+        // Tiles are visited in order, every visit accumulates the next pass of the tile.
+        result.push_back(Benchmark{ "film_add_samples", "pixels", TILE_SIZE * TILE_SIZE, [=](int iterations) {
+            auto tile_samples = reinterpret_cast<float3(*)[TILE_SIZE]>(samples->data());
+
+            for (int i = 0; i < iterations; i++) {
+                int tile_index = i % static_cast<int>(next_passes->size());
+                film->add_samples(tile_index % film->tiles_x, tile_index / film->tiles_x, (*next_passes)[tile_index]++, tile_samples);
+            }
+        } });
+    }
+
+    {
+        auto film = std::make_shared<Film>(FILM_WIDTH, FILM_HEIGHT);
+
+        float3 samples[TILE_SIZE][TILE_SIZE];
+        for (int tile_y = 0; tile_y < film->tiles_y; tile_y++) {
+            for (int tile_x = 0; tile_x < film->tiles_x; tile_x++) {
+                for (int y = 0; y < TILE_SIZE; y++) {
+                    for (int x = 0; x < TILE_SIZE; x++) {
+                        samples[y][x] = float3(random.rand(), random.rand(), random.rand()) * 2.0;
+                    }
+                }
+                film->add_samples(tile_x, tile_y, 0, samples);
+            }
+        }
+
+        auto rgba = std::make_shared<std::vector<uint32_t>>(static_cast<size_t>(FILM_WIDTH) * FILM_HEIGHT);
+
+        result.push_back(Benchmark{ "film_blit", "pixels", static_cast<double>(FILM_WIDTH) * FILM_HEIGHT, [=](int iterations) {
+            for (int i = 0; i < iterations; i++) {
+                film->blit(rgba->data(), FILM_WIDTH * static_cast<int>(sizeof(uint32_t)));
+            }
+            g_sink = (*rgba)[0];
+        } });
+    }
+
+    {
+        struct DenoiseInput {
+            std::vector<float> rgb;
+            std::vector<float> albedo;
+            std::vector<float> normal;
+            std::vector<float> depth;
+            std::vector<float> variance;
+            std::vector<float> result;
+        };
+
+        // Noise over quadrants of different albedo, normal and depth, so that the edge stopping weights take both paths.
+        auto input = std::make_shared<DenoiseInput>();
+        size_t pixel_count = static_cast<size_t>(DENOISE_WIDTH) * DENOISE_HEIGHT;
+        input->rgb.resize(pixel_count * 3);
+        input->albedo.resize(pixel_count * 3);
+        input->normal.resize(pixel_count * 3);
+        input->depth.resize(pixel_count);
+        input->variance.resize(pixel_count);
+        input->result.resize(pixel_count * 3);
+
+        for (int y = 0; y < DENOISE_HEIGHT; y++) {
+            for (int x = 0; x < DENOISE_WIDTH; x++) {
+                size_t index = static_cast<size_t>(y) * DENOISE_WIDTH + x;
+                int quadrant = (y * 2 / DENOISE_HEIGHT) * 2 + x * 2 / DENOISE_WIDTH;
+
+                for (int c = 0; c < 3; c++) {
+                    input->rgb[index * 3 + c] = static_cast<float>(random.rand() * 2.0);
+                    input->albedo[index * 3 + c] = 0.25f * (quadrant + 1);
+                    input->normal[index * 3 + c] = c == quadrant % 3 ? 1.0f : 0.0f;
+                }
+                input->depth[index] = 1.0f + quadrant + static_cast<float>(x) / DENOISE_WIDTH;
+                input->variance[index] = static_cast<float>(random.rand() * 0.1);
+            }
+        }
+
+        result.push_back(Benchmark{ "denoise", "pixels", static_cast<double>(pixel_count), [=](int iterations) {
+            DenoiserFeatures features{ input->albedo.data(), input->normal.data(), input->depth.data(), input->variance.data() };
+            for (int i = 0; i < iterations; i++) {
+                denoise(DENOISE_WIDTH, DENOISE_HEIGHT, input->rgb.data(), features, input->result.data());
+            }
+            g_sink = input->result[0];
+        } });
+    }
+
+    {
+        auto scene = std::make_shared<Scene>(build_cornell_box());
+        auto rays = std::make_shared<std::vector<Ray>>(generate_camera_rays(random, Camera(1.0)));
+
+        result.push_back(Benchmark{ "scene_raycast", "rays", 1.0, [=](int iterations) {
+            double sum = 0.0;
+            for (int i = 0; i < iterations; i++) {
+                const Ray& ray = (*rays)[i % INPUT_COUNT];
+                if (std::optional<SceneHit> hit = scene->raycast(ray.origin, ray.direction)) {
+                    sum += hit->distance;
+                }
+            }
+            g_sink = sum;
+        } });
+
+        // The generator is reseeded so that every sample traces the same paths.
+        result.push_back(Benchmark{ "path_trace", "paths", 1.0, [=](int iterations) {
+            Random path_random(INPUT_SEED);
+            g_sink = trace_paths(path_random, *scene, *rays, iterations);
+        } });
+    }
+
+    if (procedural) {
+        // Built once rather than benchmarked, a large scene takes seconds.
+        auto start = std::chrono::steady_clock::now();
+        auto scene = std::make_shared<Scene>(build_procedural_scene(*procedural));
+        std::printf("Built %d procedural primitives in %.2f s\n\n", procedural->primitive_count, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+        auto rays = std::make_shared<std::vector<Ray>>(generate_camera_rays(random, Camera(1.0)));
+
+        result.push_back(Benchmark{ "procedural_raycast", "rays", 1.0, [=](int iterations) {
+            double sum = 0.0;
+            for (int i = 0; i < iterations; i++) {
+                const Ray& ray = (*rays)[i % INPUT_COUNT];
+                if (std::optional<SceneHit> hit = scene->raycast(ray.origin, ray.direction)) {
+                    sum += hit->distance;
+                }
+            }
+            g_sink = sum;
+        } });
+
+        // Every light is visited for the PDF of a direction, which is what many lights make slow.
+        result.push_back(Benchmark{ "procedural_light_pdf", "directions", 1.0, [=](int iterations) {
+            double sum = 0.0;
+            for (int i = 0; i < iterations; i++) {
+                const Ray& ray = (*rays)[i % INPUT_COUNT];
+                sum += scene->light_pdf(ray.origin, ray.direction);
+            }
+            g_sink = sum;
+        } });
+
+        result.push_back(Benchmark{ "procedural_path_trace", "paths", 1.0, [=](int iterations) {
+            Random path_random(INPUT_SEED);
+            g_sink = trace_paths(path_random, *scene, *rays, iterations);
+        } });
+    }
+
+    return result;
+}
+
+static void print_usage(const char* executable) {
+    std::fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --filter <text>      run only the benchmarks whose name contains the text\n"
+        "  --samples <count>    timed samples per benchmark (default %d)\n"
+        "  --primitives <count> also benchmark a procedural scene with the given number of primitives\n"
+        "  --layout <name>      uniform, clustered, overlapping or many-lights layout of the procedural scene\n"
+        "                       (default uniform)\n",
+        executable, DEFAULT_SAMPLE_COUNT);
+}
+
+int main(int arc, char* argv[]) {
+    std::string filter;
+    int sample_count = DEFAULT_SAMPLE_COUNT;
+
+    // Zero for no procedural scene.
+    int primitive_count = 0;
+    ProceduralLayout layout = ProceduralLayout::UNIFORM;
+    bool is_valid = true;
+
+    for (int i = 1; i < arc; i++) {
+        if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < arc) {
+            filter = argv[++i];
+        } else if (std::strcmp(argv[i], "--samples") == 0 && i + 1 < arc) {
+            sample_count = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--primitives") == 0 && i + 1 < arc) {
+            primitive_count = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--layout") == 0 && i + 1 < arc) {
+            const char* value = argv[++i];
+
+            if (std::strcmp(value, "uniform") == 0) {
+                layout = ProceduralLayout::UNIFORM;
+            } else if (std::strcmp(value, "clustered") == 0) {
+                layout = ProceduralLayout::CLUSTERED;
+            } else if (std::strcmp(value, "overlapping") == 0) {
+                layout = ProceduralLayout::OVERLAPPING;
+            } else if (std::strcmp(value, "many-lights") == 0) {
+                layout = ProceduralLayout::MANY_LIGHTS;
+            } else {
+                is_valid = false;
+            }
+        } else {
+            is_valid = false;
+        }
+    }
+
+    if (!is_valid || sample_count < 2 || primitive_count < 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    std::optional<ProceduralSceneOptions> procedural;
+    if (primitive_count > 0) {
+        procedural = ProceduralSceneOptions{ primitive_count, layout, INPUT_SEED };
+    }
+
+    std::vector<Benchmark> benchmarks = build_benchmarks(procedural);
+
+    std::printf("%-24s %26s %12s %28s\n", "benchmark", "ns/op (95% CI)", "ops/sample", "throughput (95% CI)");
+
+    for (const Benchmark& benchmark : benchmarks) {
+        if (benchmark.name.find(filter) == std::string::npos) {
+            continue;
+        }
+
+        Measurement measurement = measure(benchmark, sample_count);
+
+        // The relative error of the throughput is the same as that of the time per operation, to the first order.
+        double throughput = benchmark.items_per_op * 1e3 / measurement.ns_per_op;
+        double throughput_error = throughput * measurement.ns_per_op_error / measurement.ns_per_op;
+
+        std::printf("%-24s %14.2f +- %8.2f %12d %12.2f +- %6.2f M%s/s\n", benchmark.name.c_str(), measurement.ns_per_op, measurement.ns_per_op_error,
+            measurement.iterations, throughput, throughput_error, benchmark.item_name.c_str());
+    }
+
+    return 0;
+}
@@ -0,0 +1,83 @@
+#include "camera.h"
+
+#include <cassert>
+
+static constexpr double PITCH_MAX = radians(89.0);
+
+Camera::Camera(double aspect, double fov_y)
+    : m_position(0.0)
+    , m_yaw(0.0)
+    , m_pitch(0.0)
+    , m_fov_y(fov_y)
+    , m_aspect(aspect)
+{
+    assert(std::isfinite(aspect) && aspect > 0.0);
+    assert(std::isfinite(fov_y) && fov_y > 0.0 && fov_y < PI);
+
+    update();
+}
+
+void Camera::set_position(const float3& position) {
+    assert(isfinite(position));
+
+    m_position = position;
+}
+
+const float3& Camera::position() const {
+    return m_position;
+}
+
+void Camera::set_rotation(double yaw, double pitch) {
+    assert(std::isfinite(yaw));
+    assert(std::isfinite(pitch));
+
+    m_yaw = std::remainder(yaw, 2.0 * PI);
+    m_pitch = clamp(pitch, -PITCH_MAX, PITCH_MAX);
+
+    update();
+}
+
+double Camera::yaw() const {
+    return m_yaw;
+}
+
+double Camera::pitch() const {
+    return m_pitch;
+}
+
+void Camera::set_fov(double fov_y) {
+    assert(std::isfinite(fov_y) && fov_y > 0.0 && fov_y < PI);
+
+    m_fov_y = fov_y;
+
+    update();
+}
+
+double Camera::fov() const {
+    return m_fov_y;
+}
+
+const float3& Camera::forward() const {
+    return m_forward;
+}
+
+const float3& Camera::right() const {
+    return m_right;
+}
+
+const float3& Camera::up() const {
+    return m_up;
+}
+
+float3 Camera::ray_direction(double normalized_x, double normalized_y) const {
+    float3 direction = normalize(point_transform(float3(normalized_x, normalized_y, 1.0), m_inv_projection));
+    return m_right * direction.x + m_up * direction.y + m_forward * direction.z;
+}
+
+void Camera::update() {
+    m_forward = float3(std::sin(m_yaw) * std::cos(m_pitch), std::sin(m_pitch), std::cos(m_yaw) * std::cos(m_pitch));
+    m_right = normalize(cross(float3(0.0, 1.0, 0.0), m_forward));
+    m_up = cross(m_forward, m_right);
+
+    m_inv_projection = inverse(float4x4::perspective(m_fov_y, m_aspect, 1.0, 10.0));
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "maths.h"
+
+class Camera {
+public:
+    Camera(double aspect, double fov_y = radians(30.0));
+
+    void set_position(const float3& position);
+    const float3& position() const;
+
+    // Yaw rotates the camera around the world up axis, pitch tilts it up and down. Both are in radians.
+    void set_rotation(double yaw, double pitch);
+    double yaw() const;
+    double pitch() const;
+
+    void set_fov(double fov_y);
+    double fov() const;
+
+    const float3& forward() const;
+    const float3& right() const;
+    const float3& up() const;
+
+    // Returns a world space direction of the ray through the given point of the image in normalized device coordinates.
+    float3 ray_direction(double normalized_x, double normalized_y) const;
+
+private:
+    void update();
+
+    float3 m_position;
+    double m_yaw;
+    double m_pitch;
+    double m_fov_y;
+    double m_aspect;
+
+    float3 m_forward;
+    float3 m_right;
+    float3 m_up;
+    float4x4 m_inv_projection;
+};
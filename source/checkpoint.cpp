@@ -0,0 +1,126 @@
+#include "checkpoint.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+static constexpr char CHECKPOINT_MAGIC[8] = { 'P', 'T', 'C', 'K', 'P', 'T', '0', '2' };
+
+// Slots start at page boundaries, so that flushing one doesn't touch the other.
+static constexpr size_t CHECKPOINT_ALIGNMENT = 4096;
+
+struct Checkpoint::Header {
+    char magic[8];
+    uint64_t key;
+    int32_t tiles_x;
+    int32_t tiles_y;
+
+    // Zero marks a slot that is empty or being written, the slot with the greatest sequence is the last checkpoint.
+    uint64_t sequences[2];
+};
+
+static uint64_t hash(const std::string& value) {
+    // FNV-1a, stable across platforms and runs.
+    uint64_t result = 0xCBF29CE484222325ull;
+    for (char c : value) {
+        result ^= static_cast<uint8_t>(c);
+        result *= 0x100000001B3ull;
+    }
+    return result;
+}
+
+std::unique_ptr<Checkpoint> Checkpoint::open(const std::string& path, const std::string& description, int tiles_x, int tiles_y) {
+    assert(tiles_x > 0 && tiles_y > 0);
+    static_assert(sizeof(Header) <= CHECKPOINT_ALIGNMENT, "header must fit in its page");
+
+    size_t slot_size = (static_cast<size_t>(tiles_x) * tiles_y * sizeof(FilmTileState) + CHECKPOINT_ALIGNMENT - 1) / CHECKPOINT_ALIGNMENT * CHECKPOINT_ALIGNMENT;
+
+    std::unique_ptr<MappedFile> file = MappedFile::open(path, CHECKPOINT_ALIGNMENT + 2 * slot_size);
+    if (file == nullptr) {
+        return nullptr;
+    }
+
+    std::unique_ptr<Checkpoint> result(new Checkpoint(std::move(file), slot_size));
+
+    // Anything that isn't a checkpoint of the same render is discarded.
+    Header& header = result->header();
+    uint64_t key = hash(description);
+    if (std::memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0 || header.key != key || header.tiles_x != tiles_x || header.tiles_y != tiles_y) {
+        std::memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+        header.key = key;
+        header.tiles_x = tiles_x;
+        header.tiles_y = tiles_y;
+        header.sequences[0] = 0;
+        header.sequences[1] = 0;
+    }
+
+    return result;
+}
+
+Checkpoint::Checkpoint(std::unique_ptr<MappedFile> file, size_t slot_size)
+    : m_file(std::move(file))
+    , m_slot_size(slot_size)
+{
+    assert(m_file != nullptr);
+}
+
+bool Checkpoint::load(Film& film) const {
+    const Header& header = this->header();
+    assert(header.tiles_x == film.tiles_x && header.tiles_y == film.tiles_y);
+
+    if (header.sequences[0] == 0 && header.sequences[1] == 0) {
+        return false;
+    }
+
+    int index = header.sequences[0] > header.sequences[1] ? 0 : 1;
+
+    size_t row_size = static_cast<size_t>(film.tiles_x) * sizeof(FilmTileState);
+    for (int tile_y = 0; tile_y < film.tiles_y; tile_y++) {
+        film.load(slot(index), tile_y, tile_y + 1);
+        m_file->evict(CHECKPOINT_ALIGNMENT + index * m_slot_size + tile_y * row_size, row_size);
+    }
+
+    return true;
+}
+
+bool Checkpoint::save(const Film& film) {
+    TraceScope trace_scope("checkpoint save");
+
+    Header& header = this->header();
+    assert(header.tiles_x == film.tiles_x && header.tiles_y == film.tiles_y);
+
+    // The older slot is overwritten, it's marked as incomplete on disk before any of its tiles change.
+    int index = header.sequences[0] <= header.sequences[1] ? 0 : 1;
+    uint64_t sequence = std::max(header.sequences[0], header.sequences[1]) + 1;
+
+    header.sequences[index] = 0;
+    if (!m_file->flush(0, sizeof(Header))) {
+        return false;
+    }
+
+    // The slot is about as large as the film, so it's written back and evicted a row of tiles at a time like the film.
+    size_t row_size = static_cast<size_t>(film.tiles_x) * sizeof(FilmTileState);
+    for (int tile_y = 0; tile_y < film.tiles_y; tile_y++) {
+        film.save(slot(index), tile_y, tile_y + 1);
+
+        size_t row_offset = CHECKPOINT_ALIGNMENT + index * m_slot_size + tile_y * row_size;
+        if (!m_file->flush(row_offset, row_size)) {
+            return false;
+        }
+        m_file->evict(row_offset, row_size);
+    }
+
+    header.sequences[index] = sequence;
+    return m_file->flush(0, sizeof(Header));
+}
+
+Checkpoint::Header& Checkpoint::header() const {
+    return *static_cast<Header*>(m_file->data());
+}
+
+FilmTileState* Checkpoint::slot(int index) const {
+    assert(index == 0 || index == 1);
+
+    return reinterpret_cast<FilmTileState*>(static_cast<char*>(m_file->data()) + CHECKPOINT_ALIGNMENT + index * m_slot_size);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "film.h"
+#include "mapped_file.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Film state kept in a memory mapped file. The file holds two slots that are written alternately, so a checkpoint
+// interrupted halfway never replaces the last complete one.
+class Checkpoint {
+public:
+    // `description` identifies the render, a checkpoint of a different render is never loaded. Returns nullptr if the
+    // file can't be opened.
+    static std::unique_ptr<Checkpoint> open(const std::string& path, const std::string& description, int tiles_x, int tiles_y);
+
+    // Returns whether the file had a complete checkpoint to load.
+    bool load(Film& film) const;
+
+    // Returns false if the checkpoint couldn't be written to disk.
+    bool save(const Film& film);
+
+private:
+    struct Header;
+
+    Checkpoint(std::unique_ptr<MappedFile> file, size_t slot_size);
+
+    Header& header() const;
+    FilmTileState* slot(int index) const;
+
+    std::unique_ptr<MappedFile> m_file;
+    size_t m_slot_size;
+};
@@ -0,0 +1,573 @@
+#include "camera.h"
+#include "checkpoint.h"
+#include "denoiser.h"
+#include "image.h"
+#include "integrator/path_tracer_integrator.h"
+#include "integrator/wavefront_integrator.h"
+#include "mapped_file.h"
+#include "scenes/cornell_box.h"
+#include "scenes/procedural_scene.h"
+#include "scenes/scene_file.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+constexpr int DEFAULT_WIDTH = 1024;
+constexpr int DEFAULT_HEIGHT = 1024;
+constexpr int DEFAULT_SAMPLES_PER_PIXEL = 64;
+constexpr int DIFFUSE_BOUNCES_MAX = 4;
+constexpr int SPECULAR_BOUNCES_MAX = 4;
+constexpr double DEFAULT_CHECKPOINT_INTERVAL = 60.0;
+
+// The cost heatmap is scaled to this percentile, so that a few outliers don't wash it out.
+constexpr double COST_PERCENTILE = 99.0;
+
+struct Options {
+    // Zero for the setting of the scene file, or the default if it has none.
+    int width = 0;
+    int height = 0;
+    int samples_per_pixel = 0;
+    uint32_t seed = 0;
+
+    // Zero means no time limit.
+    double time_limit = 0.0;
+
+    bool is_wavefront = false;
+
+    // Zero for a thread per hardware thread.
+    int thread_count = 0;
+
+    // Accumulates passes in order, so that the output doesn't depend on the number of threads.
+    bool is_ordered = false;
+
+    // Renders with increasing thread counts instead of writing images.
+    bool is_scalability = false;
+
+    CornellBoxVariant scene = CornellBoxVariant::BOXES;
+
+    // Replace the Cornell box, the scene file takes precedence.
+    bool is_procedural = false;
+    ProceduralSceneOptions procedural;
+    std::string scene_path;
+    ToneMapping tone_mapping;
+    FilmStorage film_storage = FilmStorage::FLOAT;
+
+    // Empty for a film kept in memory.
+    std::string film_path;
+
+    std::string pfm_path;
+    std::string png_path;
+
+    // Both images are denoised, the film keeps the features of its pixels for it.
+    bool is_denoised = false;
+
+    // The film only keeps the cost of its pixels if either of them is set.
+    std::string cost_pfm_path;
+    std::string cost_png_path;
+
+    std::string checkpoint_path;
+    double checkpoint_interval = DEFAULT_CHECKPOINT_INTERVAL;
+    bool is_resume = false;
+
+    std::string stats_path;
+    std::string trace_path;
+};
+
+static void print_usage(const char* executable) {
+    std::fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --width <pixels>             image width (default %d)\n"
+        "  --height <pixels>            image height (default %d)\n"
+        "  --spp <samples>              samples per pixel (default %d)\n"
+        "  --time <seconds>             stop after the given time even if not all samples are rendered\n"
+        "  --seed <number>              seed of the samples, renders with different seeds have independent noise\n"
+        "  --wavefront                  use the wavefront integrator\n"
+        "  --threads <count>            number of render threads (default one per hardware thread)\n"
+        "  --ordered                    accumulate samples in the same order for any number of threads, for bitwise\n"
+        "                               identical output\n"
+        "  --scalability                render with 1, 2, 4... threads up to --threads and report the speedup\n"
+        "  --scene <name>               boxes, reflective or transmissive (default boxes), or a procedural scene:\n"
+        "                               uniform, clustered, overlapping or many-lights\n"
+        "  --primitives <count>         number of primitives of a procedural scene (default %d)\n"
+        "  --scene-seed <number>        seed of a procedural scene\n"
+        "  --scene-file <path>          load the scene, its camera and its settings from a file\n"
+        "  --exposure <stops>           exposure of the PNG output (default 0)\n"
+        "  --tone-mapping <operator>    clamp, reinhard or aces, for the PNG output (default clamp)\n"
+        "  --film-storage <format>      double, float or compensated (default float)\n"
+        "  --film-file <path>           keep the film in the given file rather than in memory, for large images\n"
+        "  --pfm <path>                 write linear radiance as a PFM\n"
+        "  --png <path>                 write the tone mapped image as a PNG\n"
+        "  --denoise                    denoise the PFM and PNG, guided by the first hit albedo, normal and depth\n"
+        "  --cost-pfm <path>            write the mean nanoseconds spent per sample of every pixel as a PFM\n"
+        "  --cost-png <path>            write the cost of every pixel as a heatmap PNG, scaled to the 99th percentile\n"
+        "  --checkpoint <path>          periodically save the film to the given file\n"
+        "  --checkpoint-interval <s>    seconds between checkpoints (default %.0f)\n"
+        "  --resume                     continue the render from the checkpoint file\n"
+        "  --stats <path>               write ray counts and timings as JSON\n"
+        "  --trace <path>               write a timeline of the render threads in the Chrome trace event format\n"
+        "Without --pfm and --png, render.pfm and render.png are written. Size and samples per pixel given on the\n"
+        "command line override those of the scene file.\n",
+        executable, DEFAULT_WIDTH, DEFAULT_HEIGHT, DEFAULT_SAMPLES_PER_PIXEL, ProceduralSceneOptions().primitive_count, DEFAULT_CHECKPOINT_INTERVAL);
+}
+
+static bool parse_options(int arc, char* argv[], Options& options) {
+    for (int i = 1; i < arc; i++) {
+        const char* option = argv[i];
+
+        if (std::strcmp(option, "--wavefront") == 0) {
+            options.is_wavefront = true;
+            continue;
+        }
+
+        if (std::strcmp(option, "--ordered") == 0) {
+            options.is_ordered = true;
+            continue;
+        }
+
+        if (std::strcmp(option, "--resume") == 0) {
+            options.is_resume = true;
+            continue;
+        }
+
+        if (std::strcmp(option, "--scalability") == 0) {
+            options.is_scalability = true;
+            continue;
+        }
+
+        if (std::strcmp(option, "--denoise") == 0) {
+            options.is_denoised = true;
+            continue;
+        }
+
+        if (i + 1 >= arc) {
+            return false;
+        }
+        const char* value = argv[++i];
+
+        if (std::strcmp(option, "--width") == 0) {
+            options.width = std::atoi(value);
+        } else if (std::strcmp(option, "--height") == 0) {
+            options.height = std::atoi(value);
+        } else if (std::strcmp(option, "--spp") == 0) {
+            options.samples_per_pixel = std::atoi(value);
+        } else if (std::strcmp(option, "--time") == 0) {
+            options.time_limit = std::atof(value);
+        } else if (std::strcmp(option, "--threads") == 0) {
+            options.thread_count = std::atoi(value);
+        } else if (std::strcmp(option, "--seed") == 0) {
+            options.seed = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+        } else if (std::strcmp(option, "--scene") == 0) {
+            options.is_procedural = false;
+
+            if (std::strcmp(value, "boxes") == 0) {
+                options.scene = CornellBoxVariant::BOXES;
+            } else if (std::strcmp(value, "reflective") == 0) {
+                options.scene = CornellBoxVariant::REFLECTIVE_SPHERES;
+            } else if (std::strcmp(value, "transmissive") == 0) {
+                options.scene = CornellBoxVariant::TRANSMISSIVE_SPHERES;
+            } else {
+                options.is_procedural = true;
+
+                if (std::strcmp(value, "uniform") == 0) {
+                    options.procedural.layout = ProceduralLayout::UNIFORM;
+                } else if (std::strcmp(value, "clustered") == 0) {
+                    options.procedural.layout = ProceduralLayout::CLUSTERED;
+                } else if (std::strcmp(value, "overlapping") == 0) {
+                    options.procedural.layout = ProceduralLayout::OVERLAPPING;
+                } else if (std::strcmp(value, "many-lights") == 0) {
+                    options.procedural.layout = ProceduralLayout::MANY_LIGHTS;
+                } else {
+                    return false;
+                }
+            }
+        } else if (std::strcmp(option, "--primitives") == 0) {
+            options.procedural.primitive_count = std::atoi(value);
+        } else if (std::strcmp(option, "--scene-seed") == 0) {
+            options.procedural.seed = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+        } else if (std::strcmp(option, "--scene-file") == 0) {
+            options.scene_path = value;
+        } else if (std::strcmp(option, "--exposure") == 0) {
+            options.tone_mapping.exposure = std::atof(value);
+        } else if (std::strcmp(option, "--tone-mapping") == 0) {
+            if (std::strcmp(value, "clamp") == 0) {
+                options.tone_mapping.tone_operator = ToneMappingOperator::CLAMP;
+            } else if (std::strcmp(value, "reinhard") == 0) {
+                options.tone_mapping.tone_operator = ToneMappingOperator::REINHARD;
+            } else if (std::strcmp(value, "aces") == 0) {
+                options.tone_mapping.tone_operator = ToneMappingOperator::ACES;
+            } else {
+                return false;
+            }
+        } else if (std::strcmp(option, "--film-storage") == 0) {
+            if (std::strcmp(value, "double") == 0) {
+                options.film_storage = FilmStorage::DOUBLE;
+            } else if (std::strcmp(value, "float") == 0) {
+                options.film_storage = FilmStorage::FLOAT;
+            } else if (std::strcmp(value, "compensated") == 0) {
+                options.film_storage = FilmStorage::FLOAT_COMPENSATED;
+            } else {
+                return false;
+            }
+        } else if (std::strcmp(option, "--film-file") == 0) {
+            options.film_path = value;
+        } else if (std::strcmp(option, "--pfm") == 0) {
+            options.pfm_path = value;
+        } else if (std::strcmp(option, "--png") == 0) {
+            options.png_path = value;
+        } else if (std::strcmp(option, "--cost-pfm") == 0) {
+            options.cost_pfm_path = value;
+        } else if (std::strcmp(option, "--cost-png") == 0) {
+            options.cost_png_path = value;
+        } else if (std::strcmp(option, "--checkpoint") == 0) {
+            options.checkpoint_path = value;
+        } else if (std::strcmp(option, "--checkpoint-interval") == 0) {
+            options.checkpoint_interval = std::atof(value);
+        } else if (std::strcmp(option, "--stats") == 0) {
+            options.stats_path = value;
+        } else if (std::strcmp(option, "--trace") == 0) {
+            options.trace_path = value;
+        } else {
+            return false;
+        }
+    }
+
+    if (options.pfm_path.empty() && options.png_path.empty()) {
+        options.pfm_path = "render.pfm";
+        options.png_path = "render.png";
+    }
+
+    if (options.is_resume && options.checkpoint_path.empty()) {
+        return false;
+    }
+
+    return options.width >= 0 && options.height >= 0 && options.samples_per_pixel >= 0 && options.time_limit >= 0.0 && options.checkpoint_interval > 0.0 && options.thread_count >= 0 &&
+        options.procedural.primitive_count > 0;
+}
+
+// Loads the scene file or builds the scene given by the options. Returns false if the file can't be loaded.
+static bool build_scene(const Options& options, SceneFile& result) {
+    if (!options.scene_path.empty()) {
+        std::string error;
+        if (!load_scene_file(options.scene_path, result, error)) {
+            std::fprintf(stderr, "%s\n", error.c_str());
+            return false;
+        }
+
+        std::printf("Loaded %zu primitives, %zu geometries and %zu materials from %s in %.3f s (%.3f s reading, %.3f s parsing)\n", result.primitives.size(),
+            result.geometry_keys.size(), result.material_keys.size(), options.scene_path.c_str(), result.read_seconds + result.parse_seconds, result.read_seconds, result.parse_seconds);
+        return true;
+    }
+
+    if (options.is_procedural) {
+        auto start = std::chrono::steady_clock::now();
+
+        result.primitives = build_procedural_scene(options.procedural);
+
+        std::printf("Built %d procedural primitives in %.2f s\n", options.procedural.primitive_count, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        return true;
+    }
+
+    result.primitives = build_cornell_box(options.scene);
+    return true;
+}
+
+// Fills in the settings the command line doesn't give from the scene, or the defaults.
+static void apply_scene_settings(Options& options, const SceneFileSettings& settings) {
+    if (options.width == 0) {
+        options.width = settings.width > 0 ? settings.width : DEFAULT_WIDTH;
+    }
+    if (options.height == 0) {
+        options.height = settings.height > 0 ? settings.height : DEFAULT_HEIGHT;
+    }
+    if (options.samples_per_pixel == 0) {
+        options.samples_per_pixel = settings.samples_per_pixel > 0 ? settings.samples_per_pixel : DEFAULT_SAMPLES_PER_PIXEL;
+    }
+}
+
+// The scene is copied, so that it's built only once for several integrators.
+static std::unique_ptr<Integrator> create_integrator(const Options& options, const SceneFile& scene, int thread_count, std::unique_ptr<MappedFile> film_file) {
+    Camera camera(static_cast<double>(options.width) / options.height, scene.settings.camera_fov);
+    camera.set_position(scene.settings.camera_position);
+    camera.set_rotation(scene.settings.camera_yaw, scene.settings.camera_pitch);
+
+    FilmAovs film_aovs;
+    film_aovs.cost = !options.cost_pfm_path.empty() || !options.cost_png_path.empty();
+    film_aovs.features = options.is_denoised;
+
+    std::vector<Primitive> primitives = scene.primitives;
+
+    if (options.is_wavefront) {
+        return std::make_unique<WavefrontIntegrator>(options.width, options.height, options.samples_per_pixel, DIFFUSE_BOUNCES_MAX, SPECULAR_BOUNCES_MAX, camera, std::move(primitives), options.film_storage, std::move(film_file), options.seed, thread_count, film_aovs, options.is_ordered);
+    }
+    return std::make_unique<PathTracerIntegrator>(options.width, options.height, options.samples_per_pixel, DIFFUSE_BOUNCES_MAX, SPECULAR_BOUNCES_MAX, camera, std::move(primitives), options.film_storage, std::move(film_file), options.seed, thread_count, film_aovs, options.is_ordered);
+}
+
+// Renders the same image with 1, 2, 4... threads. A thread is idle for the part of the render time it doesn't spend on
+// tiles, which is where contention and load imbalance show up.
+static void run_scalability(const Options& options, const SceneFile& scene) {
+    int thread_count_max = options.thread_count > 0 ? options.thread_count : std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+
+    std::vector<int> thread_counts;
+    for (int thread_count = 1; thread_count < thread_count_max; thread_count *= 2) {
+        thread_counts.push_back(thread_count);
+    }
+    thread_counts.push_back(thread_count_max);
+
+    std::printf("%8s %10s %10s %9s %11s %10s %10s\n", "threads", "seconds", "Mrays/s", "speedup", "efficiency", "idle mean", "idle max");
+
+    double single_thread_seconds = 0.0;
+
+    for (int thread_count : thread_counts) {
+        auto start = std::chrono::steady_clock::now();
+
+        std::unique_ptr<Integrator> integrator = create_integrator(options, scene, thread_count, nullptr);
+        assert(integrator != nullptr);
+
+        integrator->wait();
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        RenderStats stats = integrator->stats();
+
+        if (thread_count == 1) {
+            single_thread_seconds = seconds;
+        }
+
+        double idle_sum = 0.0;
+        double idle_max = 0.0;
+        for (double render_seconds : stats.thread_render_seconds) {
+            double idle = std::max(seconds - render_seconds, 0.0) / seconds;
+            idle_sum += idle;
+            idle_max = std::max(idle_max, idle);
+        }
+
+        // The integrator starts fewer threads than asked for if there are fewer tiles.
+        double speedup = single_thread_seconds / seconds;
+        std::printf("%8d %10.3f %10.2f %9.2f %10.1f%% %9.1f%% %9.1f%%\n", stats.thread_count, seconds, stats.rays() / seconds * 1e-6, speedup,
+            speedup / stats.thread_count * 100.0, idle_sum / stats.thread_count * 100.0, idle_max * 100.0);
+    }
+}
+
+int main(int arc, char* argv[]) {
+    Options options;
+    if (!parse_options(arc, argv, options)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    // Scalability renders are not traced.
+    if (!options.trace_path.empty() && !options.is_scalability) {
+        Trace::start();
+        Trace::set_thread_name("Main thread");
+    }
+
+    SceneFile scene;
+    if (!build_scene(options, scene)) {
+        return 1;
+    }
+    apply_scene_settings(options, scene.settings);
+
+    if (options.is_scalability) {
+        run_scalability(options, scene);
+        return 0;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::unique_ptr<MappedFile> film_file;
+    if (!options.film_path.empty()) {
+        film_file = MappedFile::create(options.film_path, Film::file_size(options.width, options.height, options.film_storage));
+        if (film_file == nullptr) {
+            std::fprintf(stderr, "Failed to create %s\n", options.film_path.c_str());
+            return 1;
+        }
+    }
+
+    std::unique_ptr<Integrator> integrator = create_integrator(options, scene, options.thread_count, std::move(film_file));
+    assert(integrator != nullptr);
+
+    // Everything that changes the samples of a tile pass must be part of the description.
+    std::string scene_description = std::to_string(static_cast<int>(options.scene));
+    if (!options.scene_path.empty()) {
+        scene_description = "file " + options.scene_path;
+    } else if (options.is_procedural) {
+        scene_description = "procedural " + std::to_string(static_cast<int>(options.procedural.layout)) + " primitives " + std::to_string(options.procedural.primitive_count) +
+            " seed " + std::to_string(options.procedural.seed);
+    }
+
+    std::string description = std::to_string(options.width) + "x" + std::to_string(options.height) + " spp " + std::to_string(options.samples_per_pixel) +
+        " scene " + scene_description + " seed " + std::to_string(options.seed) + (options.is_wavefront ? " wavefront" : " path tracer");
+
+    std::unique_ptr<Checkpoint> checkpoint;
+    if (!options.checkpoint_path.empty()) {
+        checkpoint = Checkpoint::open(options.checkpoint_path, description, integrator->film().tiles_x, integrator->film().tiles_y);
+        if (checkpoint == nullptr) {
+            std::fprintf(stderr, "Failed to open %s\n", options.checkpoint_path.c_str());
+            return 1;
+        }
+    }
+
+    if (options.is_resume) {
+        bool is_loaded = false;
+        integrator->restore([&](Film& film) {
+            is_loaded = checkpoint->load(film);
+        });
+
+        std::printf(is_loaded ? "Resumed from %s\n" : "No checkpoint in %s, starting from scratch\n", options.checkpoint_path.c_str());
+    }
+
+    auto save_checkpoint = [&] {
+        if (checkpoint != nullptr && !checkpoint->save(integrator->film())) {
+            std::fprintf(stderr, "Failed to write %s\n", options.checkpoint_path.c_str());
+        }
+    };
+
+    bool is_finished = false;
+    while (!is_finished) {
+        if (checkpoint == nullptr && options.time_limit == 0.0) {
+            is_finished = integrator->wait();
+            break;
+        }
+
+        double timeout = checkpoint != nullptr ? options.checkpoint_interval : options.time_limit;
+        if (options.time_limit > 0.0) {
+            double remaining = options.time_limit - std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (remaining <= 0.0) {
+                break;
+            }
+            timeout = std::min(timeout, remaining);
+        }
+
+        is_finished = integrator->wait_for(std::chrono::duration<double>(timeout));
+        if (!is_finished) {
+            save_checkpoint();
+        }
+    }
+
+    // Waits for the passes in flight, so the checkpoint, the stats and the images all hold the same passes.
+    integrator->pause();
+
+    // A render stopped by the time limit can be resumed later.
+    save_checkpoint();
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::printf("%s in %.2f s\n", is_finished ? "Finished" : "Time limit reached", elapsed);
+
+    RenderStats stats = integrator->stats();
+    std::printf("%.2f Mrays/s, %.2f Msamples/s, %.0f%% of the render time in raycasts\n", stats.rays() / elapsed * 1e-6, stats.camera_rays / elapsed * 1e-6,
+        stats.render_seconds > 0.0 ? stats.raycast_seconds / stats.render_seconds * 100.0 : 0.0);
+
+    if (!options.stats_path.empty() && !write_stats_json(options.stats_path, description, stats, elapsed)) {
+        std::fprintf(stderr, "Failed to write %s\n", options.stats_path.c_str());
+    }
+
+    const Film& film = integrator->film();
+
+    // Images are written a row of tiles at a time, so that they don't need to fit in memory either.
+    auto evict_rows = [&](int y_from) {
+        film.evict(y_from / TILE_SIZE * film.tiles_x, (y_from / TILE_SIZE + 1) * film.tiles_x);
+    };
+
+    // The denoiser needs the whole image, so a denoised image is written in one go.
+    std::vector<float> denoised;
+    if (options.is_denoised) {
+        DenoiserOptions denoiser_options;
+        denoiser_options.thread_count = options.thread_count;
+
+        denoised.resize(static_cast<size_t>(film.width) * film.height * 3);
+
+        auto start = std::chrono::steady_clock::now();
+        denoise_film(film, denoised.data(), denoiser_options);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::printf("Denoised in %.1f ms, %.1f ms per megapixel\n", seconds * 1e3, seconds * 1e3 / (film.width * 1e-6 * film.height));
+    }
+
+    if (!options.pfm_path.empty() && !denoised.empty()) {
+        if (!write_pfm(options.pfm_path, film.width, film.height, denoised.data())) {
+            std::fprintf(stderr, "Failed to write %s\n", options.pfm_path.c_str());
+            return 1;
+        }
+    } else if (!options.pfm_path.empty()) {
+        bool is_written = write_pfm(options.pfm_path, film.width, film.height, TILE_SIZE, [&](int y_from, int y_to, float* rgb) {
+            film.resolve(rgb, y_from, y_to);
+            evict_rows(y_from);
+        });
+
+        if (!is_written) {
+            std::fprintf(stderr, "Failed to write %s\n", options.pfm_path.c_str());
+            return 1;
+        }
+    }
+
+    if (!options.png_path.empty() && !denoised.empty()) {
+        std::vector<uint32_t> rgba(static_cast<size_t>(film.width) * film.height);
+        tone_map(options.tone_mapping, denoised.data(), nullptr, film.width * film.height, rgba.data());
+
+        if (!write_png(options.png_path, film.width, film.height, rgba.data())) {
+            std::fprintf(stderr, "Failed to write %s\n", options.png_path.c_str());
+            return 1;
+        }
+    } else if (!options.png_path.empty()) {
+        integrator->set_tone_mapping(options.tone_mapping);
+
+        bool is_written = write_png(options.png_path, film.width, film.height, TILE_SIZE, [&](int y_from, int y_to, uint32_t* rgba) {
+            film.blit(rgba, film.width * static_cast<int>(sizeof(uint32_t)), y_from, y_to);
+            evict_rows(y_from);
+        });
+
+        if (!is_written) {
+            std::fprintf(stderr, "Failed to write %s\n", options.png_path.c_str());
+            return 1;
+        }
+    }
+
+    if (film.aovs.cost) {
+        // Costs are always kept in memory, they are written in one go.
+        size_t pixel_count = static_cast<size_t>(film.width) * film.height;
+
+        std::vector<float> costs(pixel_count);
+        film.resolve_cost(costs.data());
+
+        if (!options.cost_pfm_path.empty()) {
+            std::vector<float> rgb(pixel_count * 3);
+            for (size_t i = 0; i < pixel_count; i++) {
+                rgb[i * 3 + 0] = rgb[i * 3 + 1] = rgb[i * 3 + 2] = costs[i];
+            }
+
+            if (!write_pfm(options.cost_pfm_path, film.width, film.height, rgb.data())) {
+                std::fprintf(stderr, "Failed to write %s\n", options.cost_pfm_path.c_str());
+                return 1;
+            }
+        }
+
+        if (!options.cost_png_path.empty()) {
+            std::vector<uint32_t> rgba(pixel_count);
+            heatmap(costs.data(), static_cast<int>(pixel_count), percentile(costs.data(), static_cast<int>(pixel_count), COST_PERCENTILE), rgba.data());
+
+            if (!write_png(options.cost_png_path, film.width, film.height, rgba.data())) {
+                std::fprintf(stderr, "Failed to write %s\n", options.cost_png_path.c_str());
+                return 1;
+            }
+        }
+    }
+
+    // The trace buffers of the render threads must not be written while the trace reads them. Pausing only parks the
+    // threads, so they are joined first.
+    integrator.reset();
+
+    if (!options.trace_path.empty() && !Trace::write(options.trace_path)) {
+        std::fprintf(stderr, "Failed to write %s\n", options.trace_path.c_str());
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,257 @@
+#include "camera.h"
+#include "image.h"
+#include "integrator/path_tracer_integrator.h"
+#include "integrator/wavefront_integrator.h"
+#include "scenes/cornell_box.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+constexpr int DEFAULT_WIDTH = 256;
+constexpr int DEFAULT_HEIGHT = 256;
+constexpr int DEFAULT_REFERENCE_SAMPLES_PER_PIXEL = 4096;
+constexpr double DEFAULT_TIME_LIMIT = 30.0;
+constexpr double DEFAULT_INTERVAL = 1.0;
+constexpr int DIFFUSE_BOUNCES_MAX = 4;
+constexpr int SPECULAR_BOUNCES_MAX = 4;
+
+// More passes than any render finishes within its time limit, the render is always stopped by the clock.
+constexpr int SAMPLES_PER_PIXEL_MAX = 1 << 20;
+
+// The reference is rendered from other samples than the measured renders, otherwise the error of the first passes
+// would be underestimated.
+constexpr uint32_t REFERENCE_SEED = 0x5EED;
+
+// Keeps the relative error of black pixels finite.
+constexpr double RELATIVE_MSE_EPSILON = 1e-2;
+
+struct SceneInfo {
+    const char* name;
+    CornellBoxVariant variant;
+};
+
+static constexpr SceneInfo SCENES[] = {
+    { "boxes", CornellBoxVariant::BOXES },
+    { "reflective", CornellBoxVariant::REFLECTIVE_SPHERES },
+    { "transmissive", CornellBoxVariant::TRANSMISSIVE_SPHERES },
+};
+
+struct Options {
+    int width = DEFAULT_WIDTH;
+    int height = DEFAULT_HEIGHT;
+    double time_limit = DEFAULT_TIME_LIMIT;
+    double interval = DEFAULT_INTERVAL;
+    bool is_wavefront = false;
+
+    // Empty for all scenes.
+    std::string scene;
+
+    std::string reference_directory = "references";
+    int reference_samples_per_pixel = DEFAULT_REFERENCE_SAMPLES_PER_PIXEL;
+
+    // Empty for the standard output.
+    std::string csv_path;
+};
+
+struct ImageError {
+    double rmse;
+    double relative_mse;
+};
+
+static void print_usage(const char* executable) {
+    std::fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --width <pixels>             image width (default %d)\n"
+        "  --height <pixels>            image height (default %d)\n"
+        "  --time <seconds>             render time of every scene (default %.0f)\n"
+        "  --interval <seconds>         render time between error measurements (default %.0f)\n"
+        "  --wavefront                  measure the wavefront integrator\n"
+        "  --scene <name>               boxes, reflective or transmissive (default all of them)\n"
+        "  --references <directory>     where reference images are kept (default references)\n"
+        "  --reference-spp <samples>    samples per pixel of missing references (default %d)\n"
+        "  --csv <path>                 write the error curves to the given file instead of the standard output\n"
+        "Missing references are rendered with the path tracer and saved as <scene>_<width>x<height>.pfm first.\n",
+        executable, DEFAULT_WIDTH, DEFAULT_HEIGHT, DEFAULT_TIME_LIMIT, DEFAULT_INTERVAL, DEFAULT_REFERENCE_SAMPLES_PER_PIXEL);
+}
+
+static bool parse_options(int arc, char* argv[], Options& options) {
+    for (int i = 1; i < arc; i++) {
+        const char* option = argv[i];
+
+        if (std::strcmp(option, "--wavefront") == 0) {
+            options.is_wavefront = true;
+            continue;
+        }
+
+        if (i + 1 >= arc) {
+            return false;
+        }
+        const char* value = argv[++i];
+
+        if (std::strcmp(option, "--width") == 0) {
+            options.width = std::atoi(value);
+        } else if (std::strcmp(option, "--height") == 0) {
+            options.height = std::atoi(value);
+        } else if (std::strcmp(option, "--time") == 0) {
+            options.time_limit = std::atof(value);
+        } else if (std::strcmp(option, "--interval") == 0) {
+            options.interval = std::atof(value);
+        } else if (std::strcmp(option, "--scene") == 0) {
+            options.scene = value;
+            if (std::none_of(std::begin(SCENES), std::end(SCENES), [&](const SceneInfo& scene) { return options.scene == scene.name; })) {
+                return false;
+            }
+        } else if (std::strcmp(option, "--references") == 0) {
+            options.reference_directory = value;
+        } else if (std::strcmp(option, "--reference-spp") == 0) {
+            options.reference_samples_per_pixel = std::atoi(value);
+        } else if (std::strcmp(option, "--csv") == 0) {
+            options.csv_path = value;
+        } else {
+            return false;
+        }
+    }
+
+    return options.width > 0 && options.height > 0 && options.time_limit > 0.0 && options.interval > 0.0 && options.reference_samples_per_pixel > 0;
+}
+
+static std::unique_ptr<Integrator> create_integrator(const Options& options, bool is_wavefront, CornellBoxVariant variant, int samples_per_pixel, uint32_t seed) {
+    Camera camera(static_cast<double>(options.width) / options.height);
+
+    if (is_wavefront) {
+        return std::make_unique<WavefrontIntegrator>(options.width, options.height, samples_per_pixel, DIFFUSE_BOUNCES_MAX, SPECULAR_BOUNCES_MAX, camera, build_cornell_box(variant), FilmStorage::FLOAT, nullptr, seed);
+    }
+    return std::make_unique<PathTracerIntegrator>(options.width, options.height, samples_per_pixel, DIFFUSE_BOUNCES_MAX, SPECULAR_BOUNCES_MAX, camera, build_cornell_box(variant), FilmStorage::FLOAT, nullptr, seed);
+}
+
+// Loads the reference of the scene or renders it if there is none of the right size.
+static bool load_reference(const Options& options, const SceneInfo& scene, std::vector<float>& reference) {
+    std::string path = options.reference_directory + "/" + scene.name + "_" + std::to_string(options.width) + "x" + std::to_string(options.height) + ".pfm";
+
+    int width;
+    int height;
+    if (read_pfm(path, width, height, reference) && width == options.width && height == options.height) {
+        return true;
+    }
+
+    std::fprintf(stderr, "Rendering the reference %s at %d spp\n", path.c_str(), options.reference_samples_per_pixel);
+
+    std::unique_ptr<Integrator> integrator = create_integrator(options, false, scene.variant, options.reference_samples_per_pixel, REFERENCE_SEED);
+    assert(integrator != nullptr);
+
+    if (!integrator->wait()) {
+        std::fprintf(stderr, "Failed to render the reference %s\n", path.c_str());
+        return false;
+    }
+
+    reference.resize(static_cast<size_t>(options.width) * options.height * 3);
+    integrator->film().resolve(reference.data());
+
+    std::error_code error;
+    std::filesystem::create_directories(options.reference_directory, error);
+
+    if (!write_pfm(path, options.width, options.height, reference.data())) {
+        std::fprintf(stderr, "Failed to write %s\n", path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+static ImageError measure_error(const std::vector<float>& image, const std::vector<float>& reference) {
+    assert(image.size() == reference.size() && !image.empty());
+
+    double squared_error_sum = 0.0;
+    double relative_squared_error_sum = 0.0;
+
+    for (size_t i = 0; i < image.size(); i++) {
+        double squared_error = sqr(static_cast<double>(image[i]) - reference[i]);
+
+        squared_error_sum += squared_error;
+        relative_squared_error_sum += squared_error / (sqr(static_cast<double>(reference[i])) + RELATIVE_MSE_EPSILON);
+    }
+
+    return ImageError{ std::sqrt(squared_error_sum / image.size()), relative_squared_error_sum / image.size() };
+}
+
+// Renders the scene for the time limit and writes a row of the error curve after every interval.
+static void measure_convergence(const Options& options, const SceneInfo& scene, const std::vector<float>& reference, FILE* csv) {
+    std::unique_ptr<Integrator> integrator = create_integrator(options, options.is_wavefront, scene.variant, SAMPLES_PER_PIXEL_MAX, 0);
+    assert(integrator != nullptr);
+
+    std::vector<float> image(reference.size());
+
+    double pixel_count = static_cast<double>(options.width) * options.height;
+    double render_seconds = 0.0;
+
+    while (render_seconds < options.time_limit) {
+        auto start = std::chrono::steady_clock::now();
+
+        integrator->wait_for(std::chrono::duration<double>(std::min(options.interval, options.time_limit - render_seconds)));
+
+        // The passes in flight are finished and counted as render time, the time spent on measuring isn't.
+        integrator->pause();
+        render_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        integrator->film().resolve(image.data());
+        ImageError error = measure_error(image, reference);
+
+        // Camera rays are full resolution samples only, preview passes are counted apart.
+        RenderStats stats = integrator->stats();
+        std::fprintf(csv, "%s,%s,%.3f,%.3f,%.6g,%.6g\n", scene.name, options.is_wavefront ? "wavefront" : "path_tracer", render_seconds,
+            stats.camera_rays / pixel_count, error.rmse, error.relative_mse);
+        std::fflush(csv);
+
+        integrator->resume();
+    }
+}
+
+int main(int arc, char* argv[]) {
+    Options options;
+    if (!parse_options(arc, argv, options)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    FILE* csv = stdout;
+    if (!options.csv_path.empty()) {
+        csv = std::fopen(options.csv_path.c_str(), "w");
+        if (csv == nullptr) {
+            std::fprintf(stderr, "Failed to open %s\n", options.csv_path.c_str());
+            return 1;
+        }
+    }
+
+    std::fprintf(csv, "scene,integrator,seconds,samples_per_pixel,rmse,relative_mse\n");
+
+    int result = 0;
+
+    for (const SceneInfo& scene : SCENES) {
+        if (!options.scene.empty() && options.scene != scene.name) {
+            continue;
+        }
+
+        std::vector<float> reference;
+        if (!load_reference(options, scene, reference)) {
+            result = 1;
+            continue;
+        }
+
+        measure_convergence(options, scene, reference, csv);
+    }
+
+    if (csv != stdout) {
+        std::fclose(csv);
+    }
+
+    return result;
+}
@@ -0,0 +1,243 @@
+#include "denoiser.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <thread>
+#include <vector>
+
+// Every thread filters at least this many rows, spawning threads costs more than filtering fewer of them.
+static constexpr int PARALLEL_ROWS = 32;
+
+// B3 spline, the kernel of every iteration before its taps are spread apart.
+static constexpr float KERNEL[5] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+static constexpr float GAUSSIAN[3] = { 0.25f, 0.5f, 0.25f };
+
+// Taps whose weight is below e^-EXPONENT_MAX are skipped, their squared weights would be denormals otherwise.
+static constexpr float EXPONENT_MAX = 30.0f;
+
+// Calls `filter_rows(y_from, y_to)` for bands of rows on up to `thread_count` threads, including the calling one.
+static void parallel_rows(int height, int thread_count, const std::function<void(int, int)>& filter_rows) {
+    int band_count = std::clamp(height / PARALLEL_ROWS, 1, thread_count);
+    if (band_count == 1) {
+        filter_rows(0, height);
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(band_count - 1);
+
+    for (int i = 1; i < band_count; i++) {
+        threads.push_back(std::thread(filter_rows, height * i / band_count, height * (i + 1) / band_count));
+    }
+
+    filter_rows(0, height / band_count);
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+static float bits_to_float(uint32_t bits) {
+    float result;
+    std::memcpy(&result, &bits, sizeof(float));
+    return result;
+}
+
+// e^-x for x in [0, EXPONENT_MAX], within 0.02% of `std::exp` and several times faster. With x = (i + f) / ln 2 the
+// result is 2^-(i + 1) built from the float bits times 2^(1 - f) from a cubic fit, truncation is the floor of positive
+// values and doesn't need SSE4.1.
+static float exp_negative(float x) {
+    assert(x >= 0.0f && x <= EXPONENT_MAX);
+
+    float power = x * 1.44269504f;
+    int integer = static_cast<int>(power);
+    float fraction = 1.0f - (power - static_cast<float>(integer));
+
+    float scale = bits_to_float(static_cast<uint32_t>(126 - integer) << 23);
+    return scale * (1.0f + fraction * (0.6951786f + fraction * (0.2261570f + fraction * 0.0786648f)));
+}
+
+static float luminance(const float* rgb) {
+    return 0.212671f * rgb[0] + 0.715160f * rgb[1] + 0.072169f * rgb[2];
+}
+
+void denoise(int width, int height, const float* rgb, const DenoiserFeatures& features, float* result, const DenoiserOptions& options) {
+    TraceScope trace_scope("denoise");
+
+    assert(width > 0 && height > 0);
+    assert(rgb != nullptr && result != nullptr && rgb != result);
+    assert(features.albedo != nullptr && features.normal != nullptr && features.depth != nullptr && features.variance != nullptr);
+    assert(options.iterations > 0);
+    assert(options.luminance_sigma > 0.0 && options.normal_sigma > 0.0 && options.depth_sigma > 0.0 && options.albedo_sigma > 0.0);
+
+    int thread_count = options.thread_count > 0 ? options.thread_count : std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+    size_t pixel_count = static_cast<size_t>(width) * height;
+
+    const float* depth = features.depth;
+    const float* normal = features.normal;
+    const float* albedo = features.albedo;
+
+    // The smaller of the one sided differences, so that the gradient stays small next to depth edges.
+    std::vector<float> depth_gradients(pixel_count);
+    parallel_rows(height, thread_count, [&](int y_from, int y_to) {
+        auto difference = [&](size_t index, int x, int y) {
+            return x >= 0 && x < width && y >= 0 && y < height ? std::abs(depth[static_cast<size_t>(y) * width + x] - depth[index]) : std::numeric_limits<float>::infinity();
+        };
+
+        for (int y = y_from; y < y_to; y++) {
+            for (int x = 0; x < width; x++) {
+                size_t index = static_cast<size_t>(y) * width + x;
+
+                float gradient_x = std::min(difference(index, x - 1, y), difference(index, x + 1, y));
+                float gradient_y = std::min(difference(index, x, y - 1), difference(index, x, y + 1));
+                gradient_x = std::isinf(gradient_x) ? 0.0f : gradient_x;
+                gradient_y = std::isinf(gradient_y) ? 0.0f : gradient_y;
+
+                depth_gradients[index] = std::sqrt(gradient_x * gradient_x + gradient_y * gradient_y);
+            }
+        }
+    });
+
+    // Reciprocal distances of the taps from the center, in steps. Infinite for the center, which isn't edge stopped.
+    float inverse_tap_distances[5][5];
+    for (int i = 0; i < 5; i++) {
+        for (int j = 0; j < 5; j++) {
+            inverse_tap_distances[i][j] = 1.0f / std::sqrt(static_cast<float>((i - 2) * (i - 2) + (j - 2) * (j - 2)));
+        }
+    }
+
+    auto normal_scale = static_cast<float>(1.0 / options.normal_sigma);
+    auto albedo_scale = static_cast<float>(1.0 / options.albedo_sigma);
+
+    std::vector<float> buffer(pixel_count * 3);
+    std::vector<float> luminances(pixel_count);
+    std::vector<float> variance(features.variance, features.variance + pixel_count);
+    std::vector<float> filtered_variance(pixel_count);
+    std::vector<float> next_variance(pixel_count);
+
+    for (int iteration = 0; iteration < options.iterations; iteration++) {
+        // Iterations alternate between the buffers so that the last one writes to `result`.
+        const float* input = iteration == 0 ? rgb : (options.iterations - iteration) % 2 == 0 ? result : buffer.data();
+        float* output = (options.iterations - iteration) % 2 == 1 ? result : buffer.data();
+        int step = 1 << iteration;
+
+        for (size_t i = 0; i < pixel_count; i++) {
+            luminances[i] = luminance(input + i * 3);
+        }
+
+        // The variance of a single pixel is too noisy an estimate to scale the luminance weight by.
+        parallel_rows(height, thread_count, [&](int y_from, int y_to) {
+            for (int y = y_from; y < y_to; y++) {
+                for (int x = 0; x < width; x++) {
+                    float sum = 0.0f;
+                    float weight_sum = 0.0f;
+
+                    for (int i = -1; i <= 1; i++) {
+                        for (int j = -1; j <= 1; j++) {
+                            int tap_x = x + j;
+                            int tap_y = y + i;
+                            if (tap_x >= 0 && tap_x < width && tap_y >= 0 && tap_y < height) {
+                                float weight = GAUSSIAN[i + 1] * GAUSSIAN[j + 1];
+                                sum += variance[static_cast<size_t>(tap_y) * width + tap_x] * weight;
+                                weight_sum += weight;
+                            }
+                        }
+                    }
+
+                    filtered_variance[static_cast<size_t>(y) * width + x] = sum / weight_sum;
+                }
+            }
+        });
+
+        parallel_rows(height, thread_count, [&](int y_from, int y_to) {
+            for (int y = y_from; y < y_to; y++) {
+                for (int x = 0; x < width; x++) {
+                    size_t index = static_cast<size_t>(y) * width + x;
+
+                    const float* color = input + index * 3;
+                    const float* pixel_normal = normal + index * 3;
+                    const float* pixel_albedo = albedo + index * 3;
+                    float pixel_luminance = luminances[index];
+                    float pixel_depth = depth[index];
+
+                    float luminance_scale = 1.0f / (static_cast<float>(options.luminance_sigma) * std::sqrt(filtered_variance[index]) + 1e-6f);
+                    float depth_scale = 1.0f / (static_cast<float>(options.depth_sigma) * depth_gradients[index] * step + 1e-6f);
+
+                    // The center is not edge stopped.
+                    float center_weight = KERNEL[2] * KERNEL[2];
+                    float sum[3] = { color[0] * center_weight, color[1] * center_weight, color[2] * center_weight };
+                    float weight_sum = center_weight;
+                    float variance_sum = variance[index] * center_weight * center_weight;
+
+                    for (int i = 0; i < 5; i++) {
+                        int tap_y = y + (i - 2) * step;
+                        if (tap_y < 0 || tap_y >= height) {
+                            continue;
+                        }
+
+                        for (int j = 0; j < 5; j++) {
+                            int tap_x = x + (j - 2) * step;
+                            if (tap_x < 0 || tap_x >= width || (i == 2 && j == 2)) {
+                                continue;
+                            }
+
+                            size_t tap_index = static_cast<size_t>(tap_y) * width + tap_x;
+                            const float* tap_color = input + tap_index * 3;
+                            const float* tap_normal = normal + tap_index * 3;
+                            const float* tap_albedo = albedo + tap_index * 3;
+
+                            float normal_cos = pixel_normal[0] * tap_normal[0] + pixel_normal[1] * tap_normal[1] + pixel_normal[2] * tap_normal[2];
+                            float albedo_difference = std::abs(pixel_albedo[0] - tap_albedo[0]) + std::abs(pixel_albedo[1] - tap_albedo[1]) + std::abs(pixel_albedo[2] - tap_albedo[2]);
+
+                            // All the weights in a single exponential.
+                            float exponent = std::abs(pixel_luminance - luminances[tap_index]) * luminance_scale + (1.0f - normal_cos) * normal_scale +
+                                std::abs(pixel_depth - depth[tap_index]) * depth_scale * inverse_tap_distances[i][j] + albedo_difference * albedo_scale;
+                            if (exponent > EXPONENT_MAX) {
+                                continue;
+                            }
+
+                            float weight = KERNEL[i] * KERNEL[j] * exp_negative(exponent);
+
+                            sum[0] += tap_color[0] * weight;
+                            sum[1] += tap_color[1] * weight;
+                            sum[2] += tap_color[2] * weight;
+                            weight_sum += weight;
+                            variance_sum += variance[tap_index] * weight * weight;
+                        }
+                    }
+
+                    output[index * 3 + 0] = sum[0] / weight_sum;
+                    output[index * 3 + 1] = sum[1] / weight_sum;
+                    output[index * 3 + 2] = sum[2] / weight_sum;
+                    next_variance[index] = variance_sum / (weight_sum * weight_sum);
+                }
+            }
+        });
+
+        std::swap(variance, next_variance);
+    }
+}
+
+void denoise_film(const Film& film, float* result, const DenoiserOptions& options) {
+    assert(film.aovs.features);
+
+    size_t pixel_count = static_cast<size_t>(film.width) * film.height;
+
+    std::vector<float> rgb(pixel_count * 3);
+    std::vector<float> albedo(pixel_count * 3);
+    std::vector<float> normal(pixel_count * 3);
+    std::vector<float> depth(pixel_count);
+    std::vector<float> variance(pixel_count);
+
+    film.resolve(rgb.data());
+    film.resolve_features(albedo.data(), normal.data(), depth.data(), variance.data());
+
+    denoise(film.width, film.height, rgb.data(), DenoiserFeatures{ albedo.data(), normal.data(), depth.data(), variance.data() }, result, options);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "film.h"
+
+// Features of `width * height` pixels, rows from top to bottom as written by `Film::resolve_features`.
+struct DenoiserFeatures {
+    // Triplets.
+    const float* albedo;
+    const float* normal;
+
+    const float* depth;
+
+    // Of the mean luminance of the pixel.
+    const float* variance;
+};
+
+struct DenoiserOptions {
+    // The kernel covers 4 * 2^iterations + 1 pixels across.
+    int iterations = 5;
+
+    // Edge stopping weights fall off exponentially with the difference of luminance in standard deviations, with one
+    // minus the cosine between normals, with the depth difference relative to the depth gradient and with the sum of
+    // albedo differences. A larger sigma blurs more across the differences.
+    double luminance_sigma = 4.0;
+    double normal_sigma = 1.0 / 64.0;
+    double depth_sigma = 1.0;
+    double albedo_sigma = 0.1;
+
+    // Zero for a thread per hardware thread.
+    int thread_count = 0;
+};
+
+// Edge-avoiding à-trous wavelet filter guided by the features, with the luminance weight scaled by the filtered
+// variance of every pixel and the variance carried through the iterations. Converged pixels are kept as they are and
+// noisy ones are blurred within surfaces of the same normal, depth and albedo. Writes `width * height` RGB triplets to
+// `result`, which must not overlap `rgb`.
+void denoise(int width, int height, const float* rgb, const DenoiserFeatures& features, float* result, const DenoiserOptions& options = DenoiserOptions());
+
+// Resolves the film and its features, which it must keep, and denoises the whole image into `result`.
+void denoise_film(const Film& film, float* result, const DenoiserOptions& options = DenoiserOptions());
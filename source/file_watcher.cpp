@@ -0,0 +1,87 @@
+#include "file_watcher.h"
+
+#ifdef __linux__
+
+#include <climits>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+std::unique_ptr<FileWatcher> FileWatcher::watch(const std::string& path) {
+    std::unique_ptr<FileWatcher> result(new FileWatcher());
+
+    size_t separator = path.find_last_of('/');
+    std::string directory = separator != std::string::npos ? path.substr(0, separator + 1) : ".";
+    result->m_name = separator != std::string::npos ? path.substr(separator + 1) : path;
+
+    result->m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (result->m_inotify < 0) {
+        return nullptr;
+    }
+
+    // Creation isn't watched, the file is still empty then. Writing it ends with a close, replacing it with a move.
+    if (inotify_add_watch(result->m_inotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        return nullptr;
+    }
+
+    return result;
+}
+
+FileWatcher::~FileWatcher() {
+    if (m_inotify >= 0) {
+        close(m_inotify);
+    }
+}
+
+bool FileWatcher::has_changed() {
+    bool result = false;
+
+    // Large enough for at least one event with the longest name.
+    alignas(inotify_event) char buffer[sizeof(inotify_event) + NAME_MAX + 1];
+
+    while (true) {
+        ssize_t size = read(m_inotify, buffer, sizeof(buffer));
+        if (size <= 0) {
+            return result;
+        }
+
+        for (ssize_t offset = 0; offset < size;) {
+            const auto* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+            if (event->len > 0 && m_name == event->name) {
+                result = true;
+            }
+            offset += sizeof(inotify_event) + event->len;
+        }
+    }
+}
+
+#else
+
+std::unique_ptr<FileWatcher> FileWatcher::watch(const std::string& path) {
+    std::unique_ptr<FileWatcher> result(new FileWatcher());
+    result->m_path = path;
+
+    std::error_code error;
+    result->m_write_time = std::filesystem::last_write_time(path, error);
+    if (error) {
+        return nullptr;
+    }
+
+    return result;
+}
+
+FileWatcher::~FileWatcher() {
+}
+
+bool FileWatcher::has_changed() {
+    // A file that is being replaced may briefly not exist, it's seen once it does again.
+    std::error_code error;
+    std::filesystem::file_time_type write_time = std::filesystem::last_write_time(m_path, error);
+    if (error || write_time == m_write_time) {
+        return false;
+    }
+
+    m_write_time = write_time;
+    return true;
+}
+
+#endif
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#ifndef __linux__
+#include <filesystem>
+#endif
+
+// Tells when a file was written. The directory of the file is watched rather than the file itself, so that saves that
+// replace the file, like most editors do, are seen as well. Uses inotify on Linux and compares the modification time
+// elsewhere.
+class FileWatcher {
+public:
+    // Returns nullptr if the directory of the file can't be watched.
+    static std::unique_ptr<FileWatcher> watch(const std::string& path);
+
+    ~FileWatcher();
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    // Returns whether the file was written since the previous call, without blocking. Only finished writes are seen,
+    // a file that is written again while it's read is reported by the next call.
+    bool has_changed();
+
+private:
+    FileWatcher() = default;
+
+#ifdef __linux__
+    std::string m_name;
+    int m_inotify = -1;
+#else
+    std::string m_path;
+    std::filesystem::file_time_type m_write_time;
+#endif
+};
@@ -1,38 +1,162 @@
 #include "film.h"
+#include "trace.h"
 
+#include <algorithm>
 #include <cassert>
-#include <mutex>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
-static double gamma_correct(double value) {
-    if (value <= 0.0031308) {
-        return 12.92 * value;
-    }
+static_assert(sizeof(float3) == 3 * sizeof(double), "samples are accumulated as a flat array of doubles");
+static_assert(std::is_trivially_copyable_v<float3>, "tiles are stored as plain bytes");
 
-    return 1.055 * std::pow(value, 1.0 / 2.4) - 0.055;
-}
+// Films with fewer tiles are converted on the calling thread, spawning threads costs more than the conversion.
+static constexpr size_t PARALLEL_BLIT_TILES = 256;
+
+static size_t tile_pixels_size(FilmStorage storage) {
+    constexpr size_t pixels = TILE_SIZE * TILE_SIZE;
 
-static double convert(double value) {
-    return static_cast<char>(clamp(gamma_correct(value), 0.0, 1.0) * 255.0 + 0.5);
+    switch (storage) {
+        case FilmStorage::DOUBLE:
+            return pixels * (sizeof(uint32_t) + 3 * sizeof(double));
+        case FilmStorage::FLOAT:
+            return pixels * (sizeof(uint32_t) + 3 * sizeof(float));
+        case FilmStorage::FLOAT_COMPENSATED:
+            return pixels * (sizeof(uint32_t) + 6 * sizeof(float));
+        default:
+            assert(false);
+            return 0;
+    }
 }
 
-Film::Film(int width, int height)
+Film::Film(int width, int height, FilmStorage storage, std::unique_ptr<MappedFile> file, const FilmAovs& aovs, bool is_ordered)
     : width(width)
     , height(height)
     , tiles_x((width + TILE_SIZE - 1) / TILE_SIZE)
     , tiles_y((height + TILE_SIZE - 1) / TILE_SIZE)
+    , storage(storage)
+    , aovs(aovs)
+    , is_ordered(is_ordered)
+    , m_tile_pixels_size(tile_pixels_size(storage))
+    , m_tile_block_size(TILE_DATA_SIZE + m_tile_pixels_size)
     , m_tiles(std::make_unique<Tile[]>(static_cast<size_t>(tiles_y) * tiles_x))
+    , m_file(std::move(file))
+    , m_blocks(nullptr)
+    , m_blitted_versions(std::make_unique<uint32_t[]>(static_cast<size_t>(tiles_y) * tiles_x))
 {
     assert(width > 0);
     assert(height > 0);
+    assert(m_tile_pixels_size <= TILE_PIXELS_SIZE_MAX);
+
+    if (m_file != nullptr) {
+        assert(m_file->size() >= file_size(width, height, storage));
+        m_blocks = static_cast<unsigned char*>(m_file->data());
+    } else {
+        m_memory = std::make_unique<unsigned char[]>(static_cast<size_t>(tiles_y) * tiles_x * m_tile_block_size);
+        m_blocks = m_memory.get();
+    }
+
+    if (aovs.cost) {
+        m_costs = std::make_unique<float[]>(static_cast<size_t>(tiles_y) * tiles_x * TILE_PIXELS);
+        m_cost_passes = std::make_unique<uint32_t[]>(static_cast<size_t>(tiles_y) * tiles_x);
+    }
+
+    if (aovs.features) {
+        m_features = std::make_unique<float[]>(static_cast<size_t>(tiles_y) * tiles_x * TILE_PIXELS * FEATURE_CHANNELS);
+        m_feature_passes = std::make_unique<uint32_t[]>(static_cast<size_t>(tiles_y) * tiles_x);
+    }
+
+    m_pending_passes = std::make_unique<std::vector<PendingPass>[]>(static_cast<size_t>(tiles_y) * tiles_x);
+
+    // Tile versions are even outside of writes, so every tile is converted by the first `blit_dirty`.
+    std::fill_n(m_blitted_versions.get(), static_cast<size_t>(tiles_y) * tiles_x, UINT32_MAX);
+}
+
+size_t Film::file_size(int width, int height, FilmStorage storage) {
+    assert(width > 0 && height > 0);
+
+    size_t tiles = static_cast<size_t>((width + TILE_SIZE - 1) / TILE_SIZE) * ((height + TILE_SIZE - 1) / TILE_SIZE);
+    return tiles * (TILE_DATA_SIZE + tile_pixels_size(storage));
+}
+
+bool Film::is_out_of_core() const {
+    return m_file != nullptr;
 }
 
-void Film::blit(void* rgba, int pitch) {
+void Film::evict(int begin_tile_index, int end_tile_index) const {
+    assert(begin_tile_index >= 0 && begin_tile_index <= end_tile_index && end_tile_index <= tiles_x * tiles_y);
+
+    if (m_file != nullptr) {
+        m_file->evict(begin_tile_index * m_tile_block_size, (end_tile_index - begin_tile_index) * m_tile_block_size);
+    }
+}
+
+Film::TileWriteLock::TileWriteLock(Tile& tile)
+    : m_lock(tile.mutex)
+    , m_tile(tile)
+{
+    uint32_t version = m_tile.version.load(std::memory_order_relaxed);
+    assert(version % 2 == 0);
+
+    m_tile.version.store(version + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+Film::TileWriteLock::~TileWriteLock() {
+    m_tile.version.fetch_add(1, std::memory_order_release);
+}
+
+void Film::set_tone_mapping(const ToneMapping& tone_mapping) {
+    assert(std::isfinite(tone_mapping.exposure));
+
+    m_tone_mapping = tone_mapping;
+
+    // All the pixels change, so the next `blit_dirty` converts every tile.
+    std::fill_n(m_blitted_versions.get(), static_cast<size_t>(tiles_y) * tiles_x, UINT32_MAX);
+}
+
+const ToneMapping& Film::tone_mapping() const {
+    return m_tone_mapping;
+}
+
+void Film::blit(void* rgba, int pitch) const {
+    blit(rgba, pitch, 0, height);
+}
+
+void Film::blit(void* rgba, int pitch, int y_from, int y_to) const {
     auto* data = static_cast<char*>(rgba);
     assert(data != nullptr);
-    
+    assert(pitch >= width * 4 && pitch % 4 == 0);
+    assert(y_from >= 0 && y_from < y_to && y_to <= height);
+
+    std::vector<size_t> tile_indices;
+    for (size_t i = static_cast<size_t>(y_from / TILE_SIZE) * tiles_x; i < static_cast<size_t>((y_to - 1) / TILE_SIZE + 1) * tiles_x; i++) {
+        tile_indices.push_back(i);
+    }
+
+    blit_tiles(tile_indices, data, pitch, y_from, y_to);
+}
+
+void Film::blit_dirty(void* rgba, int pitch, std::vector<FilmRect>& dirty_rects) {
+    auto* data = static_cast<char*>(rgba);
+    assert(data != nullptr);
+    assert(pitch >= width * 4 && pitch % 4 == 0);
+
+    std::vector<size_t> tile_indices;
+
     for (int i = 0; i < tiles_y; i++) {
+        bool is_previous_dirty = false;
+
         for (int j = 0; j < tiles_x; j++) {
-            Tile& tile = m_tiles[static_cast<size_t>(i) * tiles_x + j];
+            size_t tile_index = static_cast<size_t>(i) * tiles_x + j;
+
+            if (m_tiles[tile_index].version.load(std::memory_order_acquire) == m_blitted_versions[tile_index]) {
+                is_previous_dirty = false;
+                continue;
+            }
+
+            tile_indices.push_back(tile_index);
 
             int x_from = j * TILE_SIZE;
             int y_from = i * TILE_SIZE;
@@ -40,37 +164,589 @@ void Film::blit(void* rgba, int pitch) {
             int tile_width = std::min(x_from + TILE_SIZE, width) - x_from;
             int tile_height = std::min(y_from + TILE_SIZE, height) - y_from;
 
-            for (int y = 0; y < tile_height; y++) {
+            if (is_previous_dirty) {
+                dirty_rects.back().width += tile_width;
+            } else {
+                dirty_rects.push_back(FilmRect{ x_from, y_from, tile_width, tile_height });
+            }
+
+            is_previous_dirty = true;
+        }
+    }
+
+    std::vector<uint32_t> versions = blit_tiles(tile_indices, data, pitch, 0, height);
+
+    for (size_t i = 0; i < tile_indices.size(); i++) {
+        m_blitted_versions[tile_indices[i]] = versions[i];
+    }
+}
+
+std::vector<uint32_t> Film::blit_tiles(const std::vector<size_t>& tile_indices, char* data, int pitch, int y_from, int y_to) const {
+    TraceScope trace_scope("blit");
+
+    std::vector<uint32_t> versions(tile_indices.size());
+
+    auto blit_range = [&](size_t from, size_t to) {
+        auto snapshot = std::make_unique<TileSnapshot>();
+        assert(snapshot != nullptr);
+
+        for (size_t i = from; i < to; i++) {
+            size_t tile_index = tile_indices[i];
+
+            versions[i] = read_tile(tile_index, *snapshot);
+            blit_tile(*snapshot, static_cast<int>(tile_index % tiles_x), static_cast<int>(tile_index / tiles_x), data, pitch, y_from, y_to);
+        }
+    };
+
+    size_t thread_count = std::clamp<size_t>(tile_indices.size() / PARALLEL_BLIT_TILES, 1, std::max(std::thread::hardware_concurrency(), 1u));
+    if (thread_count == 1) {
+        blit_range(0, tile_indices.size());
+        return versions;
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count - 1);
+
+    for (size_t i = 1; i < thread_count; i++) {
+        threads.push_back(std::thread(blit_range, tile_indices.size() * i / thread_count, tile_indices.size() * (i + 1) / thread_count));
+    }
+
+    blit_range(0, tile_indices.size() / thread_count);
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    return versions;
+}
+
+void Film::blit_tile(TileSnapshot& snapshot, int tile_x, int tile_y, char* data, int pitch, int y_from, int y_to) const {
+    int tile_x_from = tile_x * TILE_SIZE;
+    int tile_y_from = tile_y * TILE_SIZE;
+
+    int tile_width = std::min(tile_x_from + TILE_SIZE, width) - tile_x_from;
+
+    // Tiles without samples have zero sample counts, so they are converted to black.
+    bool is_preview = snapshot.data.divider == 0.0 && snapshot.data.preview_block_size != 0;
+
+    TilePixels pixels = tile_pixels(snapshot.pixels);
+
+    float buffer[TILE_SIZE * 3];
+
+    for (int y = std::max(y_from - tile_y_from, 0); y < std::min(y_to - tile_y_from, TILE_SIZE); y++) {
+        auto* row = reinterpret_cast<uint32_t*>(data + static_cast<size_t>(tile_y_from + y - y_from) * pitch) + tile_x_from;
+
+        if (is_preview) {
+            for (int x = 0; x < tile_width; x++) {
+                const float3& sample = snapshot.data.preview[y * PREVIEW_SIZE / TILE_SIZE][x * PREVIEW_SIZE / TILE_SIZE];
+                buffer[x * 3 + 0] = static_cast<float>(sample.r);
+                buffer[x * 3 + 1] = static_cast<float>(sample.g);
+                buffer[x * 3 + 2] = static_cast<float>(sample.b);
+            }
+
+            tone_map(m_tone_mapping, buffer, nullptr, tile_width, row);
+        } else {
+            tone_map(m_tone_mapping, tile_row(snapshot, y, tile_width, buffer), pixels.sample_counts + y * TILE_SIZE, tile_width, row);
+        }
+    }
+}
+
+void Film::resolve(float* rgb) const {
+    resolve(rgb, 0, height);
+}
+
+void Film::resolve(float* rgb, int y_from, int y_to) const {
+    TraceScope trace_scope("resolve");
+
+    assert(rgb != nullptr);
+    assert(y_from >= 0 && y_from < y_to && y_to <= height);
+
+    auto snapshot = std::make_unique<TileSnapshot>();
+    assert(snapshot != nullptr);
+
+    for (int i = y_from / TILE_SIZE; i <= (y_to - 1) / TILE_SIZE; i++) {
+        for (int j = 0; j < tiles_x; j++) {
+            read_tile(static_cast<size_t>(i) * tiles_x + j, *snapshot);
+
+            TilePixels pixels = tile_pixels(snapshot->pixels);
+
+            int tile_x_from = j * TILE_SIZE;
+            int tile_y_from = i * TILE_SIZE;
+
+            int tile_width = std::min(tile_x_from + TILE_SIZE, width) - tile_x_from;
+
+            for (int y = std::max(y_from - tile_y_from, 0); y < std::min(y_to - tile_y_from, TILE_SIZE); y++) {
                 for (int x = 0; x < tile_width; x++) {
+                    int pixel_index = y * TILE_SIZE + x;
+
                     float3 spectrum;
-                    if (tile.divider != 0.0) {
-                        spectrum = tile.samples[y][x] / tile.divider;
+                    if (snapshot->data.divider != 0.0) {
+                        uint32_t sample_count = pixels.sample_counts[pixel_index];
+
+                        if (storage == FilmStorage::DOUBLE) {
+                            spectrum = float3(pixels.double_sums[pixel_index * 3 + 0], pixels.double_sums[pixel_index * 3 + 1], pixels.double_sums[pixel_index * 3 + 2]);
+                        } else {
+                            spectrum = float3(pixels.float_sums[pixel_index * 3 + 0], pixels.float_sums[pixel_index * 3 + 1], pixels.float_sums[pixel_index * 3 + 2]);
+                        }
+
+                        if (storage == FilmStorage::FLOAT_COMPENSATED) {
+                            spectrum -= float3(pixels.compensations[pixel_index * 3 + 0], pixels.compensations[pixel_index * 3 + 1], pixels.compensations[pixel_index * 3 + 2]);
+                        }
+
+                        spectrum = sample_count != 0 ? spectrum / sample_count : float3(0.0);
+                    } else if (snapshot->data.preview_block_size != 0) {
+                        spectrum = snapshot->data.preview[y * PREVIEW_SIZE / TILE_SIZE][x * PREVIEW_SIZE / TILE_SIZE];
                     }
 
-                    int offset = (i * TILE_SIZE + y) * pitch + (j * TILE_SIZE + x) * 4;
+                    float* pixel = rgb + (static_cast<size_t>(tile_y_from + y - y_from) * width + tile_x_from + x) * 3;
+                    pixel[0] = static_cast<float>(spectrum.r);
+                    pixel[1] = static_cast<float>(spectrum.g);
+                    pixel[2] = static_cast<float>(spectrum.b);
+                }
+            }
+        }
+    }
+}
+
+void Film::resolve_cost(float* costs) const {
+    assert(costs != nullptr);
+    assert(aovs.cost);
+
+    for (int i = 0; i < tiles_y; i++) {
+        for (int j = 0; j < tiles_x; j++) {
+            size_t tile_index = static_cast<size_t>(i) * tiles_x + j;
+            const float* tile_costs = m_costs.get() + tile_index * TILE_PIXELS;
+
+            int tile_width = std::min((j + 1) * TILE_SIZE, width) - j * TILE_SIZE;
+            int tile_height = std::min((i + 1) * TILE_SIZE, height) - i * TILE_SIZE;
+
+            // Costs are only read for display and export, writers of the tile may as well wait.
+            std::lock_guard<std::mutex> lock(m_tiles[tile_index].mutex);
+
+            float scale = m_cost_passes[tile_index] != 0 ? 1.0f / m_cost_passes[tile_index] : 0.0f;
+
+            for (int y = 0; y < tile_height; y++) {
+                for (int x = 0; x < tile_width; x++) {
+                    costs[static_cast<size_t>(i * TILE_SIZE + y) * width + j * TILE_SIZE + x] = tile_costs[y * TILE_SIZE + x] * scale;
+                }
+            }
+        }
+    }
+}
+
+void Film::resolve_features(float* albedo, float* normal, float* depth, float* variance) const {
+    assert(albedo != nullptr && normal != nullptr && depth != nullptr && variance != nullptr);
+    assert(aovs.features);
+
+    for (int i = 0; i < tiles_y; i++) {
+        for (int j = 0; j < tiles_x; j++) {
+            size_t tile_index = static_cast<size_t>(i) * tiles_x + j;
+            const float* tile_features = m_features.get() + tile_index * TILE_PIXELS * FEATURE_CHANNELS;
+
+            int tile_width = std::min((j + 1) * TILE_SIZE, width) - j * TILE_SIZE;
+            int tile_height = std::min((i + 1) * TILE_SIZE, height) - i * TILE_SIZE;
+
+            std::lock_guard<std::mutex> lock(m_tiles[tile_index].mutex);
+
+            uint32_t passes = m_feature_passes[tile_index];
+            float scale = passes != 0 ? 1.0f / passes : 0.0f;
+
+            for (int y = 0; y < tile_height; y++) {
+                for (int x = 0; x < tile_width; x++) {
+                    const float* sums = tile_features + (y * TILE_SIZE + x) * FEATURE_CHANNELS;
+                    size_t pixel_index = static_cast<size_t>(i * TILE_SIZE + y) * width + j * TILE_SIZE + x;
+
+                    for (int c = 0; c < 3; c++) {
+                        albedo[pixel_index * 3 + c] = sums[c] * scale;
+                        normal[pixel_index * 3 + c] = sums[3 + c] * scale;
+                    }
+                    depth[pixel_index] = sums[6] * scale;
+
+                    // Variance of the samples divided by their number is the variance of their mean.
+                    float mean = sums[7] * scale;
+                    variance[pixel_index] = std::max(sums[8] * scale - mean * mean, 0.0f) * scale;
+                }
+            }
+        }
+    }
+}
+
+void Film::clear() {
+    for (size_t i = 0; i < static_cast<size_t>(tiles_y) * tiles_x; i++) {
+        TileWriteLock lock(m_tiles[i]);
+
+        std::memset(m_blocks + i * m_tile_block_size, 0, m_tile_block_size);
+
+        if (aovs.cost) {
+            std::fill_n(m_costs.get() + i * TILE_PIXELS, TILE_PIXELS, 0.0f);
+            m_cost_passes[i] = 0;
+        }
+
+        if (aovs.features) {
+            std::fill_n(m_features.get() + i * TILE_PIXELS * FEATURE_CHANNELS, TILE_PIXELS * FEATURE_CHANNELS, 0.0f);
+            m_feature_passes[i] = 0;
+        }
+
+        m_pending_passes[i].clear();
+
+        if (i % tiles_x == static_cast<size_t>(tiles_x) - 1) {
+            evict(static_cast<int>(i) + 1 - tiles_x, static_cast<int>(i) + 1);
+        }
+    }
+}
+
+void Film::add_samples(int tile_x, int tile_y, int pass, float3 samples[TILE_SIZE][TILE_SIZE], const float costs[TILE_SIZE][TILE_SIZE], const FeatureSample features[TILE_SIZE][TILE_SIZE]) {
+    TraceScope trace_scope("add_samples", tile_x, tile_y, pass);
+
+    assert(tile_x >= 0 && tile_x < tiles_x && tile_y >= 0 && tile_y < tiles_y);
+    assert(pass >= 0);
+    assert(!aovs.cost || costs != nullptr);
+    assert(!aovs.features || features != nullptr);
+
+    const float* pass_costs = aovs.cost ? costs[0] : nullptr;
+    const FeatureSample* pass_features = aovs.features ? features[0] : nullptr;
+
+    size_t tile_index = static_cast<size_t>(tile_y) * tiles_x + tile_x;
+    TileData& data = tile_data(tile_index);
+
+    TileWriteLock lock(m_tiles[tile_index]);
+
+    assert(static_cast<uint32_t>(pass) >= data.pass_count);
+
+    // An ordered film only accumulates the next pass. Others accumulate any pass that fits the pass mask, those further
+    // ahead wait until it does so that every accumulated pass is tracked.
+    auto is_ready = [&](int pending_pass) {
+        auto pass_offset = static_cast<uint32_t>(pending_pass) - data.pass_count;
+        return is_ordered ? pass_offset == 0 : pass_offset < PASS_MASK_BITS;
+    };
+
+    std::vector<PendingPass>& pending_passes = m_pending_passes[tile_index];
+
+    if (!is_ready(pass)) {
+        PendingPass pending_pass{ pass, std::make_unique<float3[]>(TILE_PIXELS), nullptr, nullptr };
+        std::copy_n(samples[0], TILE_PIXELS, pending_pass.samples.get());
+
+        if (aovs.cost) {
+            pending_pass.costs = std::make_unique<float[]>(TILE_PIXELS);
+            std::copy_n(pass_costs, TILE_PIXELS, pending_pass.costs.get());
+        }
+
+        if (aovs.features) {
+            pending_pass.features = std::make_unique<FeatureSample[]>(TILE_PIXELS);
+            std::copy_n(pass_features, TILE_PIXELS, pending_pass.features.get());
+        }
+
+        pending_passes.push_back(std::move(pending_pass));
+        return;
+    }
+
+    accumulate(tile_index, pass, samples[0], pass_costs, pass_features);
+
+    // Every accumulated pass may be the one the next held back pass waits for.
+    while (!pending_passes.empty()) {
+        auto next = std::find_if(pending_passes.begin(), pending_passes.end(), [&](const PendingPass& pending_pass) {
+            return is_ready(pending_pass.pass);
+        });
+
+        if (next == pending_passes.end()) {
+            break;
+        }
+
+        accumulate(tile_index, next->pass, next->samples.get(), next->costs.get(), next->features.get());
+        pending_passes.erase(next);
+    }
+}
+
+bool Film::has_pass(int tile_x, int tile_y, int pass) const {
+    assert(tile_x >= 0 && tile_x < tiles_x && tile_y >= 0 && tile_y < tiles_y);
+    assert(pass >= 0);
+
+    size_t tile_index = static_cast<size_t>(tile_y) * tiles_x + tile_x;
+    const TileData& data = tile_data(tile_index);
+
+    std::lock_guard<std::mutex> lock(m_tiles[tile_index].mutex);
+
+    auto pass_offset = static_cast<uint32_t>(pass) - data.pass_count;
+    return static_cast<uint32_t>(pass) < data.pass_count || (pass_offset < PASS_MASK_BITS && (data.pass_mask & (uint64_t(1) << pass_offset)) != 0);
+}
+
+bool Film::has_samples(int tile_x, int tile_y) const {
+    assert(tile_x >= 0 && tile_x < tiles_x && tile_y >= 0 && tile_y < tiles_y);
+
+    size_t tile_index = static_cast<size_t>(tile_y) * tiles_x + tile_x;
+
+    std::lock_guard<std::mutex> lock(m_tiles[tile_index].mutex);
+
+    return tile_data(tile_index).divider != 0.0;
+}
+
+void Film::save(FilmTileState* states, int tile_y_from, int tile_y_to) const {
+    TraceScope trace_scope("film save");
+
+    assert(states != nullptr);
+    assert(tile_y_from >= 0 && tile_y_from <= tile_y_to && tile_y_to <= tiles_y);
+
+    auto snapshot = std::make_unique<TileSnapshot>();
+    assert(snapshot != nullptr);
+
+    for (size_t i = static_cast<size_t>(tile_y_from) * tiles_x; i < static_cast<size_t>(tile_y_to) * tiles_x; i++) {
+        read_tile(i, *snapshot);
+
+        TilePixels pixels = tile_pixels(snapshot->pixels);
+
+        FilmTileState& state = states[i];
+        state.pass_count = snapshot->data.pass_count;
+        state.reserved = 0;
+        state.pass_mask = snapshot->data.pass_mask;
+        state.divider = snapshot->data.divider;
+
+        for (int j = 0; j < TILE_PIXELS; j++) {
+            float3& sample = state.samples[j / TILE_SIZE][j % TILE_SIZE];
+
+            for (int k = 0; k < 3; k++) {
+                if (storage == FilmStorage::DOUBLE) {
+                    sample[k] = pixels.double_sums[j * 3 + k];
+                } else if (storage == FilmStorage::FLOAT) {
+                    sample[k] = pixels.float_sums[j * 3 + k];
+                } else {
+                    sample[k] = static_cast<double>(pixels.float_sums[j * 3 + k]) - pixels.compensations[j * 3 + k];
+                }
+            }
+
+            state.sample_counts[j / TILE_SIZE][j % TILE_SIZE] = pixels.sample_counts[j];
+        }
+
+        // Saving an out of core film pages in a row of tiles at a time, like writing an image.
+        if (i % tiles_x == static_cast<size_t>(tiles_x) - 1) {
+            evict(static_cast<int>(i) + 1 - tiles_x, static_cast<int>(i) + 1);
+        }
+    }
+}
+
+void Film::load(const FilmTileState* states, int tile_y_from, int tile_y_to) {
+    TraceScope trace_scope("film load");
 
-                    data[offset + 0] = 0xFF;
-                    data[offset + 1] = convert(spectrum.z);
-                    data[offset + 2] = convert(spectrum.y);
-                    data[offset + 3] = convert(spectrum.x);
+    assert(states != nullptr);
+    assert(tile_y_from >= 0 && tile_y_from <= tile_y_to && tile_y_to <= tiles_y);
+
+    for (size_t i = static_cast<size_t>(tile_y_from) * tiles_x; i < static_cast<size_t>(tile_y_to) * tiles_x; i++) {
+        TileData& data = tile_data(i);
+        const FilmTileState& state = states[i];
+
+        TileWriteLock lock(m_tiles[i]);
+
+        data.pass_count = state.pass_count;
+        data.pass_mask = state.pass_mask;
+        data.divider = state.divider;
+        data.preview_block_size = 0;
+
+        TilePixels pixels = tile_pixels(pixel_block(i));
+
+        for (int j = 0; j < TILE_PIXELS; j++) {
+            const float3& sample = state.samples[j / TILE_SIZE][j % TILE_SIZE];
+
+            for (int k = 0; k < 3; k++) {
+                if (storage == FilmStorage::DOUBLE) {
+                    pixels.double_sums[j * 3 + k] = sample[k];
+                } else if (storage == FilmStorage::FLOAT) {
+                    pixels.float_sums[j * 3 + k] = static_cast<float>(sample[k]);
+                } else {
+                    // The rounding error of the float sum becomes its compensation. The sum is the same as the saved one,
+                    // but at rounding ties it may be split differently, so following samples can round differently.
+                    pixels.float_sums[j * 3 + k] = static_cast<float>(sample[k]);
+                    pixels.compensations[j * 3 + k] = static_cast<float>(pixels.float_sums[j * 3 + k] - sample[k]);
                 }
             }
+
+            pixels.sample_counts[j] = state.sample_counts[j / TILE_SIZE][j % TILE_SIZE];
+        }
+
+        if (i % tiles_x == static_cast<size_t>(tiles_x) - 1) {
+            evict(static_cast<int>(i) + 1 - tiles_x, static_cast<int>(i) + 1);
         }
     }
 }
 
-void Film::add_samples(int tile_x, int tile_y, float3 samples[TILE_SIZE][TILE_SIZE]) {
+void Film::add_preview(int tile_x, int tile_y, int block_size, float3 samples[PREVIEW_SIZE][PREVIEW_SIZE]) {
+    TraceScope trace_scope("add_preview", tile_x, tile_y, -1);
+
     assert(tile_x >= 0 && tile_x < tiles_x && tile_y >= 0 && tile_y < tiles_y);
+    assert(block_size > 0 && TILE_SIZE % block_size == 0 && TILE_SIZE / block_size <= PREVIEW_SIZE);
+
+    size_t tile_index = static_cast<size_t>(tile_y) * tiles_x + tile_x;
+    TileData& data = tile_data(tile_index);
+
+    TileWriteLock lock(m_tiles[tile_index]);
+
+    // Preview passes of the same tile may finish out of order, a coarser preview must not replace a finer one.
+    if (data.preview_block_size != 0 && data.preview_block_size <= block_size) {
+        return;
+    }
+
+    data.preview_block_size = block_size;
 
-    Tile& tile = m_tiles[static_cast<size_t>(tile_y) * tiles_x + tile_x];
-    tile.divider += 1.0;
+    int cell_size = TILE_SIZE / PREVIEW_SIZE;
 
-    for (int y = 0; y < TILE_SIZE; y++) {
-        for (int x = 0; x < TILE_SIZE; x++) {
-            assert(isfinite(samples[y][x]));
-            assert(samples[y][x].r >= 0.0 && samples[y][x].g >= 0.0 && samples[y][x].b >= 0.0);
+    for (int y = 0; y < PREVIEW_SIZE; y++) {
+        for (int x = 0; x < PREVIEW_SIZE; x++) {
+            const float3& sample = samples[y * cell_size / block_size][x * cell_size / block_size];
 
-            tile.samples[y][x] += samples[y][x];
+            assert(isfinite(sample));
+            assert(sample.r >= 0.0 && sample.g >= 0.0 && sample.b >= 0.0);
+
+            data.preview[y][x] = sample;
         }
     }
 }
+
+Film::TileData& Film::tile_data(size_t tile_index) const {
+    return *reinterpret_cast<TileData*>(m_blocks + tile_index * m_tile_block_size);
+}
+
+unsigned char* Film::pixel_block(size_t tile_index) const {
+    return m_blocks + tile_index * m_tile_block_size + TILE_DATA_SIZE;
+}
+
+Film::TilePixels Film::tile_pixels(unsigned char* pixels) const {
+    TilePixels result = {};
+    result.sample_counts = reinterpret_cast<uint32_t*>(pixels);
+
+    unsigned char* sums = pixels + TILE_PIXELS * sizeof(uint32_t);
+    if (storage == FilmStorage::DOUBLE) {
+        result.double_sums = reinterpret_cast<double*>(sums);
+    } else {
+        result.float_sums = reinterpret_cast<float*>(sums);
+    }
+
+    if (storage == FilmStorage::FLOAT_COMPENSATED) {
+        result.compensations = result.float_sums + TILE_PIXELS * 3;
+    }
+
+    return result;
+}
+
+uint32_t Film::read_tile(size_t tile_index, TileSnapshot& result) const {
+    const Tile& tile = m_tiles[tile_index];
+    const TileData& data = tile_data(tile_index);
+    const unsigned char* pixels = pixel_block(tile_index);
+
+    while (true) {
+        uint32_t version = tile.version.load(std::memory_order_acquire);
+
+        if (version % 2 == 0) {
+            std::memcpy(&result.data, &data, sizeof(TileData));
+            std::memcpy(result.pixels, pixels, m_tile_pixels_size);
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if (tile.version.load(std::memory_order_relaxed) == version) {
+                return version;
+            }
+        }
+
+        std::this_thread::yield();
+    }
+}
+
+void Film::accumulate(size_t tile_index, int pass, const float3* samples, const float* costs, const FeatureSample* features) {
+    TileData& data = tile_data(tile_index);
+
+    // Passes further ahead than the mask are held back by `add_samples`.
+    auto pass_offset = static_cast<uint32_t>(pass) - data.pass_count;
+    assert(pass_offset < PASS_MASK_BITS);
+    assert((data.pass_mask & (uint64_t(1) << pass_offset)) == 0);
+
+    data.pass_mask |= uint64_t(1) << pass_offset;
+    while ((data.pass_mask & 1) != 0) {
+        data.pass_mask >>= 1;
+        data.pass_count++;
+    }
+
+    data.divider += 1.0;
+
+    TilePixels pixels = tile_pixels(pixel_block(tile_index));
+
+    for (int i = 0; i < TILE_PIXELS; i++) {
+        assert(isfinite(samples[i]));
+        assert(samples[i].r >= 0.0 && samples[i].g >= 0.0 && samples[i].b >= 0.0);
+
+        pixels.sample_counts[i]++;
+    }
+
+    // Samples and sums are both interleaved RGB, so they are accumulated as flat arrays of channels. The storage format
+    // is the same for all tiles, the branch is taken once per tile rather than per channel.
+    const double* values = samples[0].begin();
+
+    switch (storage) {
+        case FilmStorage::DOUBLE:
+            for (int i = 0; i < TILE_PIXELS * 3; i++) {
+                pixels.double_sums[i] += values[i];
+            }
+            break;
+        case FilmStorage::FLOAT:
+            for (int i = 0; i < TILE_PIXELS * 3; i++) {
+                pixels.float_sums[i] += static_cast<float>(values[i]);
+            }
+            break;
+        case FilmStorage::FLOAT_COMPENSATED:
+            for (int i = 0; i < TILE_PIXELS * 3; i++) {
+                // The compensation holds the rounding error of the sum, the exact sum is `sum - compensation`.
+                float value = static_cast<float>(values[i]) - pixels.compensations[i];
+                float sum = pixels.float_sums[i] + value;
+                pixels.compensations[i] = (sum - pixels.float_sums[i]) - value;
+                pixels.float_sums[i] = sum;
+            }
+            break;
+        default:
+            assert(false);
+            break;
+    }
+
+    if (aovs.cost) {
+        float* tile_costs = m_costs.get() + tile_index * TILE_PIXELS;
+        for (int i = 0; i < TILE_PIXELS; i++) {
+            tile_costs[i] += costs[i];
+        }
+        m_cost_passes[tile_index]++;
+    }
+
+    if (aovs.features) {
+        float* tile_features = m_features.get() + tile_index * TILE_PIXELS * FEATURE_CHANNELS;
+        for (int i = 0; i < TILE_PIXELS; i++) {
+            const FeatureSample& feature = features[i];
+            float* sums = tile_features + i * FEATURE_CHANNELS;
+
+            for (int c = 0; c < 3; c++) {
+                sums[c] += static_cast<float>(feature.albedo[c]);
+                sums[3 + c] += static_cast<float>(feature.normal[c]);
+            }
+            sums[6] += static_cast<float>(feature.depth);
+
+            auto luminance = static_cast<float>(to_xyz(samples[i]).y);
+            sums[7] += luminance;
+            sums[8] += luminance * luminance;
+        }
+        m_feature_passes[tile_index]++;
+    }
+}
+
+const float* Film::tile_row(TileSnapshot& snapshot, int y, int tile_width, float* buffer) const {
+    TilePixels pixels = tile_pixels(snapshot.pixels);
+
+    switch (storage) {
+        case FilmStorage::DOUBLE:
+            for (int i = 0; i < tile_width * 3; i++) {
+                buffer[i] = static_cast<float>(pixels.double_sums[y * TILE_SIZE * 3 + i]);
+            }
+            return buffer;
+        case FilmStorage::FLOAT:
+            return pixels.float_sums + y * TILE_SIZE * 3;
+        case FilmStorage::FLOAT_COMPENSATED:
+            for (int i = 0; i < tile_width * 3; i++) {
+                buffer[i] = pixels.float_sums[y * TILE_SIZE * 3 + i] - pixels.compensations[y * TILE_SIZE * 3 + i];
+            }
+            return buffer;
+        default:
+            assert(false);
+            return buffer;
+    }
+}
@@ -1,18 +1,151 @@
 #pragma once
 
+#include "mapped_file.h"
 #include "maths.h"
+#include "tone_mapping.h"
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 static constexpr int TILE_SIZE = 32;
 
+// Before the full resolution passes, every tile is rendered at a low resolution: one sample per block of
+// PREVIEW_BLOCK_SIZES[pass] x PREVIEW_BLOCK_SIZES[pass] pixels. The preview is shown until the first full resolution
+// pass of the tile is accumulated and never contributes to the final image.
+static constexpr int PREVIEW_PASSES = 3;
+static constexpr int PREVIEW_BLOCK_SIZES[PREVIEW_PASSES] = { 16, 8, 4 };
+static constexpr int PREVIEW_SIZE = TILE_SIZE / PREVIEW_BLOCK_SIZES[PREVIEW_PASSES - 1];
+
+// How sums of samples are stored. Every pixel also keeps the number of its samples.
+enum class FilmStorage {
+    // 28 bytes per pixel.
+    DOUBLE,
+
+    // 16 bytes per pixel. Relative error grows with the number of samples, but stays far below what 8-bit output can
+    // show for thousands of samples per pixel.
+    FLOAT,
+
+    // 28 bytes per pixel. Kahan summation keeps the error of float sums independent of the number of samples.
+    FLOAT_COMPENSATED,
+};
+
+// Accumulated state of a tile, as stored in checkpoints. Independent of the storage format of the film.
+struct FilmTileState {
+    // Passes below `pass_count` are accumulated, as well as pass `pass_count + i` for every bit `i` set in `pass_mask`.
+    uint32_t pass_count;
+    uint32_t reserved;
+    uint64_t pass_mask;
+
+    // Number of accumulated passes.
+    double divider;
+
+    float3 samples[TILE_SIZE][TILE_SIZE];
+    uint32_t sample_counts[TILE_SIZE][TILE_SIZE];
+};
+
+// Optional per-pixel values accumulated next to the radiance.
+struct FilmAovs {
+    // Time spent on the samples of a pixel, for finding where the render time goes. Kept in memory even for films in a
+    // file and not saved in checkpoints.
+    bool cost = false;
+
+    // First hit albedo, normal and depth of the samples of a pixel and the variance of its luminance, for guiding a
+    // denoiser. Kept in memory and not saved in checkpoints like the cost.
+    bool features = false;
+};
+
+// First hit of the camera ray of a sample, for the feature AOV. Features of rays that miss the scene are zero.
+struct FeatureSample {
+    float3 albedo = float3(0.0);
+    float3 normal = float3(0.0);
+    double depth = 0.0;
+};
+
+struct FilmRect {
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+// Samples are accumulated from worker threads, while the film is read from the main thread. Writers of the same tile
+// are serialized by a mutex, readers never block the writers and take consistent snapshots of tiles instead.
+//
+// The film is kept in memory, or in a file mapped into memory for images that don't fit. Only about 76 bytes per tile
+// stay in memory in the latter case, its lock, its pending passes and its blitted version, the tiles are paged in when
+// they're accessed and `evict` pages them out. The cost and feature AOVs are always kept in memory, a value per pixel
+// and channel.
+//
+// Sums don't depend on which thread rendered a pass, but passes of a tile that finish out of order are added in the order
+// they finish, which changes the rounding of the sums. An ordered film holds such passes back until the passes before
+// them are accumulated, so that the result is bitwise the same however the passes are scheduled.
 class Film {
 public:
-    Film(int width, int height);
+    // `file` must have at least `file_size` bytes and be zero filled.
+    Film(int width, int height, FilmStorage storage = FilmStorage::FLOAT, std::unique_ptr<MappedFile> file = nullptr, const FilmAovs& aovs = FilmAovs(), bool is_ordered = false);
 
-    void blit(void* rgba, int pitch);
+    static size_t file_size(int width, int height, FilmStorage storage);
 
-    void add_samples(int tile_x, int tile_y, float3 samples[TILE_SIZE][TILE_SIZE]);
+    bool is_out_of_core() const;
+
+    // Drops tiles from `begin_tile_index` to `end_tile_index` (in row-major order) from memory, when the film is kept in
+    // a file. Their contents stay in the file and are paged back in when the tiles are accessed again.
+    void evict(int begin_tile_index, int end_tile_index) const;
+
+    // Applied by the following blits.
+    void set_tone_mapping(const ToneMapping& tone_mapping);
+    const ToneMapping& tone_mapping() const;
+
+    // Large films are converted by several threads.
+    void blit(void* rgba, int pitch) const;
+
+    // Converts rows from `y_from` to `y_to`, `rgba` points to the first of them.
+    void blit(void* rgba, int pitch, int y_from, int y_to) const;
+
+    // Converts only the tiles that changed since the previous call. Rectangles of the updated pixels are appended to
+    // `dirty_rects`, horizontally adjacent tiles are merged into one rectangle.
+    void blit_dirty(void* rgba, int pitch, std::vector<FilmRect>& dirty_rects);
+
+    // Writes `width * height` linear RGB triplets, rows from top to bottom. Tiles without full resolution samples are
+    // resolved from their preview.
+    void resolve(float* rgb) const;
+
+    // Resolves rows from `y_from` to `y_to`, `rgb` points to the first of them.
+    void resolve(float* rgb, int y_from, int y_to) const;
+
+    // Writes `width * height` mean costs per sample in nanoseconds, rows from top to bottom. Pixels without costs are
+    // zero. Requires the cost AOV.
+    void resolve_cost(float* costs) const;
+
+    // Writes `width * height` mean albedo and normal triplets, mean depths and variances of the mean luminance of the
+    // pixels, rows from top to bottom. Pixels without features are zero. Requires the feature AOV.
+    void resolve_features(float* albedo, float* normal, float* depth, float* variance) const;
+
+    // Evicts every row of tiles once it's zeroed, like `save` and `load`.
+    void clear();
+
+    // Passes are numbered from zero, not counting the preview passes. Every pass is accumulated at most once, so passes
+    // of the same tile that finish out of order are tracked. An ordered film accumulates a pass that is added ahead of
+    // an earlier pass of its tile only once the earlier pass is added, others hold back only passes more than
+    // PASS_MASK_BITS ahead. Until a held back pass is accumulated it doesn't count for `has_pass`.
+    // Films with the cost AOV require `costs`, the time spent on every sample in nanoseconds, and films with the feature
+    // AOV require `features`. Others ignore them.
+    void add_samples(int tile_x, int tile_y, int pass, float3 samples[TILE_SIZE][TILE_SIZE], const float costs[TILE_SIZE][TILE_SIZE] = nullptr,
+        const FeatureSample features[TILE_SIZE][TILE_SIZE] = nullptr);
+    bool has_pass(int tile_x, int tile_y, int pass) const;
+    bool has_samples(int tile_x, int tile_y) const;
+
+    // Only the first `TILE_SIZE / block_size` rows and columns of `samples` are used.
+    void add_preview(int tile_x, int tile_y, int block_size, float3 samples[PREVIEW_SIZE][PREVIEW_SIZE]);
+
+    // `states` holds `tiles_x * tiles_y` tiles in row-major order, only the rows of tiles from `tile_y_from` to
+    // `tile_y_to` are copied. Load must not overlap with writes to the film. Saving and loading is lossless, except for
+    // the split of compensated sums. Both evict every row of tiles once it's copied.
+    void save(FilmTileState* states, int tile_y_from, int tile_y_to) const;
+    void load(const FilmTileState* states, int tile_y_from, int tile_y_to);
 
     const int width;
     const int height;
@@ -20,11 +153,119 @@ public:
     const int tiles_x;
     const int tiles_y;
 
+    const FilmStorage storage;
+    const FilmAovs aovs;
+    const bool is_ordered;
+
 private:
+    static constexpr int TILE_PIXELS = TILE_SIZE * TILE_SIZE;
+
+    // Number of passes after `pass_count` that `pass_mask` tracks.
+    static constexpr uint32_t PASS_MASK_BITS = 64;
+
+    // Albedo, normal, depth, luminance and squared luminance.
+    static constexpr int FEATURE_CHANNELS = 9;
+
+    // Pixels of a tile are stored in an array per value: sample counts, sums and then Kahan compensations, with the
+    // sizes given by the storage format.
+    static constexpr size_t TILE_PIXELS_SIZE_MAX = TILE_PIXELS * (sizeof(uint32_t) + 3 * sizeof(double));
+
+    struct TilePixels {
+        uint32_t* sample_counts;
+        double* double_sums;
+        float* float_sums;
+        float* compensations;
+    };
+
+    // Zero filled memory is an empty tile.
+    struct TileData {
+        double divider;
+
+        uint32_t pass_count;
+        uint64_t pass_mask;
+
+        float3 preview[PREVIEW_SIZE][PREVIEW_SIZE];
+        int preview_block_size;
+    };
+
+    // Every tile is stored in a block of `m_tile_block_size` bytes, its `TileData` followed by its pixels.
+    static constexpr size_t TILE_DATA_SIZE = (sizeof(TileData) + 63) / 64 * 64;
+
     struct Tile {
-        float3 samples[TILE_SIZE][TILE_SIZE];
-        double divider = 0.0;
+        // Passes of the same tile may be rendered by different threads at the same time.
+        mutable std::mutex mutex;
+
+        // Sequence lock. Odd while the tile is being written to.
+        std::atomic<uint32_t> version{ 0 };
+    };
+
+    // Locks the tile for writing, so that readers that overlap with the write retry their read.
+    class TileWriteLock {
+    public:
+        TileWriteLock(Tile& tile);
+        ~TileWriteLock();
+
+    private:
+        std::lock_guard<std::mutex> m_lock;
+        Tile& m_tile;
+    };
+
+    // Copy of a pass that waits for the earlier passes of its tile.
+    struct PendingPass {
+        int pass;
+        std::unique_ptr<float3[]> samples;
+        std::unique_ptr<float[]> costs;
+        std::unique_ptr<FeatureSample[]> features;
+    };
+
+    struct TileSnapshot {
+        TileData data;
+        alignas(16) unsigned char pixels[TILE_PIXELS_SIZE_MAX];
     };
 
+    TileData& tile_data(size_t tile_index) const;
+    unsigned char* pixel_block(size_t tile_index) const;
+    TilePixels tile_pixels(unsigned char* pixels) const;
+
+    // Returns the version of the snapshot.
+    uint32_t read_tile(size_t tile_index, TileSnapshot& result) const;
+
+    // Must be called with the tile locked. `costs` and `features` are only read by films with their AOVs.
+    void accumulate(size_t tile_index, int pass, const float3* samples, const float* costs, const FeatureSample* features);
+
+    // Radiance of a row of the snapshot, not divided by the sample counts yet.
+    const float* tile_row(TileSnapshot& snapshot, int y, int tile_width, float* buffer) const;
+
+    // `data` points to the row `y_from`, only rows from `y_from` to `y_to` are converted. Returns the versions of the
+    // converted tiles.
+    std::vector<uint32_t> blit_tiles(const std::vector<size_t>& tile_indices, char* data, int pitch, int y_from, int y_to) const;
+    void blit_tile(TileSnapshot& snapshot, int tile_x, int tile_y, char* data, int pitch, int y_from, int y_to) const;
+
+    size_t m_tile_pixels_size;
+    size_t m_tile_block_size;
+
     std::unique_ptr<Tile[]> m_tiles;
+
+    // Tile blocks are in `m_memory` or in `m_file`.
+    std::unique_ptr<unsigned char[]> m_memory;
+    std::unique_ptr<MappedFile> m_file;
+    unsigned char* m_blocks;
+
+    std::unique_ptr<uint32_t[]> m_blitted_versions;
+
+    // Cost sums of the pixels of every tile and the number of passes they add up, guarded by the tile mutex. Checkpoints
+    // don't restore costs, so the pass count of a tile may be lower than its number of samples.
+    std::unique_ptr<float[]> m_costs;
+    std::unique_ptr<uint32_t[]> m_cost_passes;
+
+    // Sums of the FEATURE_CHANNELS of the pixels of every tile and the number of passes they add up, guarded by the
+    // tile mutex like the costs.
+    std::unique_ptr<float[]> m_features;
+    std::unique_ptr<uint32_t[]> m_feature_passes;
+
+    // Passes held back by every tile, guarded by the tile mutex. Empty unless the film is ordered or a pass finished too
+    // far ahead of the earlier ones.
+    std::unique_ptr<std::vector<PendingPass>[]> m_pending_passes;
+
+    ToneMapping m_tone_mapping;
 };
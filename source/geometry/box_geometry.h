@@ -2,7 +2,7 @@
 
 #include "geometry/geometry.h"
 
-class BoxGeometry : public Geometry {
+class BoxGeometry final : public Geometry {
 public:
     BoxGeometry(float3 half_extents);
 
@@ -0,0 +1,17 @@
+#include "geometry/geometry_variant.h"
+
+#include <cassert>
+
+GeometryVariant make_geometry_variant(const Geometry* geometry) {
+    assert(geometry != nullptr);
+
+    if (auto box_geometry = dynamic_cast<const BoxGeometry*>(geometry)) {
+        return box_geometry;
+    }
+
+    if (auto sphere_geometry = dynamic_cast<const SphereGeometry*>(geometry)) {
+        return sphere_geometry;
+    }
+
+    return geometry;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "geometry/box_geometry.h"
+#include "geometry/sphere_geometry.h"
+
+#include <variant>
+
+// Closed set of the built-in geometries, see MaterialVariant.
+using GeometryVariant = std::variant<
+    const BoxGeometry*,
+    const SphereGeometry*,
+    const Geometry*
+>;
+
+GeometryVariant make_geometry_variant(const Geometry* geometry);
@@ -2,7 +2,7 @@
 
 #include "geometry/geometry.h"
 
-class SphereGeometry : public Geometry {
+class SphereGeometry final : public Geometry {
 public:
     SphereGeometry(double radius);
 
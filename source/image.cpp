@@ -0,0 +1,216 @@
+#include "image.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <fstream>
+#include <vector>
+
+static constexpr size_t DEFLATE_STORED_BLOCK_MAX = 65535;
+
+static std::array<uint32_t, 256> build_crc_table() {
+    std::array<uint32_t, 256> result;
+
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t value = i;
+        for (int j = 0; j < 8; j++) {
+            value = (value & 1) != 0 ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+        }
+        result[i] = value;
+    }
+
+    return result;
+}
+
+static uint32_t crc32(const uint8_t* data, size_t size) {
+    static const std::array<uint32_t, 256> CRC_TABLE = build_crc_table();
+
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < size; i++) {
+        crc = CRC_TABLE[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// Continues the checksum `adler` of the preceding data, which starts at 1.
+static uint32_t adler32(uint32_t adler, const uint8_t* data, size_t size) {
+    uint32_t a = adler & 0xFFFF;
+    uint32_t b = adler >> 16;
+
+    // 5552 is the largest number of bytes that can't overflow `b` before the modulo.
+    for (size_t from = 0; from < size; from += 5552) {
+        size_t to = std::min(from + 5552, size);
+        for (size_t i = from; i < to; i++) {
+            a += data[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+
+    return (b << 16) | a;
+}
+
+static void push_u32_be(std::vector<uint8_t>& data, uint32_t value) {
+    data.push_back(static_cast<uint8_t>(value >> 24));
+    data.push_back(static_cast<uint8_t>(value >> 16));
+    data.push_back(static_cast<uint8_t>(value >> 8));
+    data.push_back(static_cast<uint8_t>(value));
+}
+
+static void write_chunk(std::ofstream& stream, const char type[4], const std::vector<uint8_t>& data) {
+    std::vector<uint8_t> chunk;
+    chunk.reserve(data.size() + 12);
+
+    push_u32_be(chunk, static_cast<uint32_t>(data.size()));
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    push_u32_be(chunk, crc32(chunk.data() + 4, chunk.size() - 4));
+
+    stream.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+}
+
+bool write_pfm(const std::string& path, int width, int height, const float* rgb) {
+    assert(rgb != nullptr);
+
+    return write_pfm(path, width, height, height, [&](int y_from, int y_to, float* rows) {
+        std::copy(rgb + static_cast<size_t>(y_from) * width * 3, rgb + static_cast<size_t>(y_to) * width * 3, rows);
+    });
+}
+
+bool write_pfm(const std::string& path, int width, int height, int band_height, const std::function<void(int, int, float*)>& read_rows) {
+    assert(width > 0 && height > 0);
+    assert(band_height > 0);
+
+    std::ofstream stream(path, std::ios::binary);
+    if (!stream) {
+        return false;
+    }
+
+    // Negative scale marks little-endian data.
+    stream << "PF\n" << width << " " << height << "\n-1.0\n";
+
+    std::vector<float> rgb(static_cast<size_t>(std::min(band_height, height)) * width * 3);
+
+    // Rows are stored from bottom to top.
+    for (int y_from = (height - 1) / band_height * band_height; y_from >= 0; y_from -= band_height) {
+        int y_to = std::min(y_from + band_height, height);
+        read_rows(y_from, y_to, rgb.data());
+
+        for (int y = y_to - 1; y >= y_from; y--) {
+            stream.write(reinterpret_cast<const char*>(rgb.data() + static_cast<size_t>(y - y_from) * width * 3), static_cast<std::streamsize>(width) * 3 * sizeof(float));
+        }
+    }
+
+    return static_cast<bool>(stream);
+}
+
+bool read_pfm(const std::string& path, int& width, int& height, std::vector<float>& rgb) {
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream) {
+        return false;
+    }
+
+    std::string format;
+    double scale;
+    stream >> format >> width >> height >> scale;
+
+    // A single whitespace character separates the header from the data.
+    stream.get();
+
+    if (!stream || format != "PF" || width <= 0 || height <= 0 || scale >= 0.0) {
+        return false;
+    }
+
+    rgb.resize(static_cast<size_t>(width) * height * 3);
+
+    // Rows are stored from bottom to top.
+    for (int y = height - 1; y >= 0; y--) {
+        stream.read(reinterpret_cast<char*>(rgb.data() + static_cast<size_t>(y) * width * 3), static_cast<std::streamsize>(width) * 3 * sizeof(float));
+    }
+
+    return static_cast<bool>(stream);
+}
+
+bool write_png(const std::string& path, int width, int height, const uint32_t* rgba) {
+    assert(rgba != nullptr);
+
+    return write_png(path, width, height, height, [&](int y_from, int y_to, uint32_t* rows) {
+        std::copy(rgba + static_cast<size_t>(y_from) * width, rgba + static_cast<size_t>(y_to) * width, rows);
+    });
+}
+
+bool write_png(const std::string& path, int width, int height, int band_height, const std::function<void(int, int, uint32_t*)>& read_rows) {
+    assert(width > 0 && height > 0);
+    assert(band_height > 0);
+
+    std::ofstream stream(path, std::ios::binary);
+    if (!stream) {
+        return false;
+    }
+
+    const uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    stream.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+    std::vector<uint8_t> header;
+    push_u32_be(header, static_cast<uint32_t>(width));
+    push_u32_be(header, static_cast<uint32_t>(height));
+    header.insert(header.end(), { 8, 2, 0, 0, 0 }); // 8 bits per channel, RGB, deflate, no filter, no interlace
+    write_chunk(stream, "IHDR", header);
+
+    std::vector<uint32_t> rgba(static_cast<size_t>(std::min(band_height, height)) * width);
+    std::vector<uint8_t> scanlines;
+    std::vector<uint8_t> zlib;
+
+    uint32_t adler = 1;
+
+    // The zlib stream may be split between any number of IDAT chunks, every band gets its own.
+    for (int y_from = 0; y_from < height; y_from += band_height) {
+        int y_to = std::min(y_from + band_height, height);
+        read_rows(y_from, y_to, rgba.data());
+
+        // Every row starts with the filter type, which is always "none".
+        scanlines.clear();
+        for (int y = 0; y < y_to - y_from; y++) {
+            scanlines.push_back(0);
+            for (int x = 0; x < width; x++) {
+                uint32_t pixel = rgba[static_cast<size_t>(y) * width + x];
+                scanlines.push_back(static_cast<uint8_t>(pixel >> 24));
+                scanlines.push_back(static_cast<uint8_t>(pixel >> 16));
+                scanlines.push_back(static_cast<uint8_t>(pixel >> 8));
+            }
+        }
+
+        zlib.clear();
+        if (y_from == 0) {
+            zlib.push_back(0x78);
+            zlib.push_back(0x01);
+        }
+
+        size_t offset = 0;
+        do {
+            size_t size = std::min(scanlines.size() - offset, DEFLATE_STORED_BLOCK_MAX);
+            bool is_final = offset + size == scanlines.size() && y_to == height;
+
+            zlib.push_back(is_final ? 1 : 0);
+            zlib.push_back(static_cast<uint8_t>(size));
+            zlib.push_back(static_cast<uint8_t>(size >> 8));
+            zlib.push_back(static_cast<uint8_t>(~size));
+            zlib.push_back(static_cast<uint8_t>(~size >> 8));
+            zlib.insert(zlib.end(), scanlines.begin() + offset, scanlines.begin() + offset + size);
+
+            offset += size;
+        } while (offset < scanlines.size());
+
+        adler = adler32(adler, scanlines.data(), scanlines.size());
+        if (y_to == height) {
+            push_u32_be(zlib, adler);
+        }
+
+        write_chunk(stream, "IDAT", zlib);
+    }
+
+    write_chunk(stream, "IEND", {});
+
+    return static_cast<bool>(stream);
+}
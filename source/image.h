@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// All functions return false if the file can't be written or read.
+//
+// Images too large for memory are written in bands of rows. `read_rows(y_from, y_to, pixels)` is called for bands of
+// `band_height` rows, starting at multiples of `band_height`, and must write the rows from `y_from` to `y_to` (rows from
+// top to bottom) to `pixels`. Bands are read in the order of the file, which is bottom to top for PFM.
+
+// Writes `width * height` linear RGB triplets (rows from top to bottom) as a little-endian Portable Float Map.
+bool write_pfm(const std::string& path, int width, int height, const float* rgb);
+bool write_pfm(const std::string& path, int width, int height, int band_height, const std::function<void(int, int, float*)>& read_rows);
+
+// Reads a Portable Float Map as written by `write_pfm`, rows from top to bottom. Only little-endian RGB is supported.
+bool read_pfm(const std::string& path, int& width, int& height, std::vector<float>& rgb);
+
+// Writes RGBA8888 pixels packed as by `Film::blit` as an 8-bit RGB PNG. Image data is stored in uncompressed deflate
+// blocks, which keeps the writer tiny at the cost of file size.
+bool write_png(const std::string& path, int width, int height, const uint32_t* rgba);
+bool write_png(const std::string& path, int width, int height, int band_height, const std::function<void(int, int, uint32_t*)>& read_rows);
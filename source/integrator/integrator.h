@@ -1,8 +1,49 @@
 #pragma once
 
+#include "camera.h"
+#include "film.h"
+#include "integrator/render_stats.h"
+#include "scene.h"
+
+#include <chrono>
+#include <functional>
+#include <vector>
+
 class Integrator {
 public:
     virtual ~Integrator() = default;
 
-    virtual void blit(void* rgba, int pitch) = 0;
+    // Converts the tiles that changed since the previous call into `rgba` and appends their rectangles to
+    // `dirty_rects`. The buffer must be kept between the calls, as the unchanged pixels are not written to.
+    virtual void blit(void* rgba, int pitch, std::vector<FilmRect>& dirty_rects) = 0;
+
+    // Changes how the following blits convert radiance to pixels, without restarting the render.
+    virtual void set_tone_mapping(const ToneMapping& tone_mapping) = 0;
+
+    // Returns once the passes in flight are finished, the film doesn't change until the render is resumed.
+    virtual void pause() = 0;
+    virtual void resume() = 0;
+
+    // Clears the film and renders all the samples again using the same threads.
+    virtual void restart() = 0;
+
+    // Restarts the render from the given camera.
+    virtual void set_camera(const Camera& camera) = 0;
+
+    // Restarts the render from the scene and camera changed by `callback`. The threads are parked while it runs, so it
+    // may replace primitives or the whole scene.
+    virtual void update_scene(const std::function<void(Scene&, Camera&)>& callback) = 0;
+
+    // Restarts the render from the film filled by `callback`. Passes that are already in the film are not rendered
+    // again.
+    virtual void restore(const std::function<void(Film&)>& callback) = 0;
+
+    // Waits until all the samples are rendered. Returns false if the render didn't finish in time.
+    virtual bool wait() = 0;
+    virtual bool wait_for(std::chrono::duration<double> timeout) = 0;
+
+    virtual const Film& film() const = 0;
+
+    // Counters of all the threads since the integrator was created, they can be read while rendering.
+    virtual RenderStats stats() const = 0;
 };
@@ -0,0 +1,14 @@
+#include "integrator/path_state.h"
+
+#include <cassert>
+
+FeatureSample hit_features(const SceneHit& hit) {
+    float3 albedo = std::visit([](auto* material) { return material->albedo(); }, hit.material);
+    return FeatureSample{ albedo, hit.normal, hit.distance };
+}
+
+bool sample_hit(Random& random, PathState& state, const Scene& scene, const SceneHit& hit, int max_diffuse_bounces, int max_specular_bounces) {
+    return std::visit([&](auto* material) {
+        return sample_hit(random, state, scene, hit, *material, max_diffuse_bounces, max_specular_bounces);
+    }, hit.material);
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "film.h"
+#include "maths.h"
+#include "random.h"
+#include "scene.h"
+
+#include <cassert>
+
+// State of a single path between two bounces. Radiance is accumulated on the way down the path and weighted by the
+// throughput, so the path can be traced in a loop (or in batches) instead of recursing once per bounce.
+struct PathState {
+    PathState(const float3& origin, const float3& direction)
+        : origin(origin)
+        , direction(direction)
+        , throughput(1.0)
+        , radiance(0.0)
+    {
+    }
+
+    float3 origin;
+    float3 direction;
+    float3 throughput;
+    float3 radiance;
+    int diffuse_bounces = 0;
+    int specular_bounces = 0;
+
+    // Pdf of the direction sampled at the last bounce, whether that bounce was specular and whether the direction was
+    // sampled towards a light rather than from the material.
+    double bsdf_pdf = 0.0;
+    bool is_specular = false;
+    bool is_light_sample = false;
+};
+
+// Features of the first hit of a camera ray.
+FeatureSample hit_features(const SceneHit& hit);
+
+// Accumulates the emission at the hit and scatters the path in a new direction. Returns false if the path terminates.
+bool sample_hit(Random& random, PathState& state, const Scene& scene, const SceneHit& hit, int max_diffuse_bounces, int max_specular_bounces);
+
+// Same as above for a hit whose material type is known at compile time, so that batches of hits sorted by material
+// type are shaded without any dynamic dispatch.
+template <typename MaterialType>
+bool sample_hit(Random& random, PathState& state, const Scene& scene, const SceneHit& hit, const MaterialType& material, int max_diffuse_bounces, int max_specular_bounces) {
+    state.radiance += state.throughput * material.emissive();
+
+    if (material.is_specular() && state.specular_bounces < max_specular_bounces) {
+        state.specular_bounces++;
+    } else {
+        state.diffuse_bounces++;
+    }
+
+    if (state.diffuse_bounces >= max_diffuse_bounces) {
+        return false;
+    }
+
+    float3x3 tangent_space = transpose(float3x3(hit.tangent, hit.bitangent, hit.normal));
+    float3x3 inverse_tangent_space = inverse(tangent_space);
+                        
+    float3 outgoing_tangent_space = normalize((-state.direction) * tangent_space);
+
+    if ((!scene.has_lights() || material.is_specular() || random.rand() < 0.5)) {
+        float3 ingoing_tangent_space;
+        double material_pdf;
+        float3 bsdf = material.bsdf(ingoing_tangent_space, outgoing_tangent_space, material_pdf, random.rand2());
+        assert(bsdf.x >= 0.0 && bsdf.y >= 0.0 && bsdf.z >= 0.0);
+        if (bsdf == float3(0.0) || ingoing_tangent_space.z == 0.0 || material_pdf == 0.0) {
+            return false;
+        }
+
+        float3 ingoing = normalize(ingoing_tangent_space * inverse_tangent_space);
+
+        double weight = 1.0;
+        if (scene.has_lights() && !material.is_specular()) {
+            weight = sqr(material_pdf) / (sqr(material_pdf) + sqr(scene.light_pdf(hit.position, ingoing)));
+        }
+
+        state.throughput *= bsdf * std::abs(ingoing_tangent_space.z) * weight / material_pdf;
+        state.origin = hit.position;
+        state.direction = ingoing;
+        state.bsdf_pdf = material_pdf;
+        state.is_specular = material.is_specular();
+        state.is_light_sample = false;
+    } else {
+        double light_random = random.rand();
+        GeometrySample geometry_sample = scene.sample_light(light_random, random.rand2());
+
+        float3 ingoing = normalize(geometry_sample.position - hit.position);
+        float3 ingoing_tangent_space = normalize(ingoing * tangent_space);
+        if (ingoing_tangent_space.z <= 0.0) {
+            return false;
+        }
+
+        double material_pdf;
+        float3 bsdf = material.bsdf(ingoing_tangent_space, outgoing_tangent_space, material_pdf);
+        assert(bsdf.x >= 0.0 && bsdf.y >= 0.0 && bsdf.z >= 0.0);
+        if (bsdf == float3(0.0) || ingoing_tangent_space.z == 0.0 || material_pdf == 0.0) {
+            return false;
+        }
+
+        double sample_pdf = scene.light_pdf(hit.position, ingoing);
+        double weight = sqr(sample_pdf) / (sqr(material_pdf) + sqr(sample_pdf));
+
+        state.throughput *= bsdf * std::abs(ingoing_tangent_space.z) * weight / sample_pdf;
+        state.origin = hit.position;
+        state.direction = ingoing;
+        state.bsdf_pdf = material_pdf;
+        state.is_specular = false;
+        state.is_light_sample = true;
+    }
+
+    return true;
+}
@@ -1,28 +1,34 @@
 #include "integrator/path_tracer_integrator.h"
 #include "random.h"
+#include "trace.h"
 
 #include <algorithm>
 #include <cassert>
 
-PathTracerIntegrator::PathTracerIntegrator(int width, int height, int samples_per_pixel, int max_diffuse_bounces, int max_specular_bounces, std::vector<Primitive>&& primitives)
-    : m_film(width, height)
+// Reading the clock around every raycast would take a noticeable share of the render time, so only the raycasts of
+// one in RAYCAST_TIMING_INTERVAL paths are timed and their time is scaled up. Paths are picked by their sample seed,
+// a counter would pick the same pixels of every tile.
+static constexpr int RAYCAST_TIMING_INTERVAL = 16;
+
+PathTracerIntegrator::PathTracerIntegrator(int width, int height, int samples_per_pixel, int max_diffuse_bounces, int max_specular_bounces, const Camera& camera, std::vector<Primitive>&& primitives, FilmStorage film_storage, std::unique_ptr<MappedFile> film_file, uint32_t seed, int thread_count, const FilmAovs& film_aovs, bool is_ordered)
+    : m_film(width, height, film_storage, std::move(film_file), film_aovs, is_ordered)
     , m_samples_per_pixel(samples_per_pixel)
     , m_max_diffuse_bounces(max_diffuse_bounces)
     , m_max_specular_bounces(max_specular_bounces)
-    , m_primitives(std::move(primitives))
+    , m_camera(camera)
+    , m_scene(std::move(primitives))
+    , m_seed(seed)
+    , m_thread_count(std::clamp(thread_count > 0 ? thread_count : static_cast<int>(std::thread::hardware_concurrency()), 1, m_film.tiles_x * m_film.tiles_y))
+    , m_counters(std::make_unique<RenderCounters[]>(m_thread_count))
+    , m_scheduler(m_thread_count, m_film.tiles_x, m_film.tiles_y, PREVIEW_PASSES + samples_per_pixel, m_film.is_out_of_core() ? m_film.tiles_x : m_film.tiles_x * m_film.tiles_y, [this](int begin_tile_index, int end_tile_index) {
+        // Rows of tiles are rendered one after another, so that a film kept in a file only needs one of them in memory.
+        m_film.evict(begin_tile_index, end_tile_index);
+    })
 {
     assert(m_samples_per_pixel > 0);
     assert(m_max_diffuse_bounces > 0);
     assert(m_max_specular_bounces >= 0);
 
-    for (Primitive& primitive : m_primitives) {
-        if (!equal(primitive.material_emissive(), 0.0)) {
-            m_light_primitives.push_back(&primitive);
-        }
-    }
-
-    m_thread_count = std::clamp(static_cast<int>(std::thread::hardware_concurrency()), 1, m_film.tiles_x * m_film.tiles_y);
-
     m_threads.reserve(m_thread_count);
     for (int i = 0; i < m_thread_count; i++) {
         m_threads.push_back(std::thread(&PathTracerIntegrator::integrate, this, i));
@@ -30,155 +36,238 @@ PathTracerIntegrator::PathTracerIntegrator(int width, int height, int samples_pe
 }
 
 PathTracerIntegrator::~PathTracerIntegrator() {
+    m_scheduler.stop();
+
     for (std::thread& thread : m_threads) {
         thread.join();
     }
 }
 
-void PathTracerIntegrator::blit(void* rgba, int pitch) {
-    m_film.blit(rgba, pitch);
+void PathTracerIntegrator::blit(void* rgba, int pitch, std::vector<FilmRect>& dirty_rects) {
+    m_film.blit_dirty(rgba, pitch, dirty_rects);
 }
 
-void PathTracerIntegrator::integrate(int thread_index) {
-    assert(thread_index >= 0 && thread_index < m_thread_count);
+void PathTracerIntegrator::set_tone_mapping(const ToneMapping& tone_mapping) {
+    m_film.set_tone_mapping(tone_mapping);
+}
+
+void PathTracerIntegrator::pause() {
+    m_scheduler.pause();
+}
+
+void PathTracerIntegrator::resume() {
+    m_scheduler.resume();
+}
+
+void PathTracerIntegrator::restart() {
+    m_scheduler.restart([this] {
+        m_film.clear();
+    });
+}
 
-    Random random(thread_index);
+void PathTracerIntegrator::set_camera(const Camera& camera) {
+    m_scheduler.restart([&] {
+        m_camera = camera;
+        m_film.clear();
+    });
+}
 
-    int tiles_total = m_film.tiles_x * m_film.tiles_y;
-    int tiles_per_thread = tiles_total / m_thread_count;
-    int threads_with_extra_tile = tiles_total % m_thread_count;
+void PathTracerIntegrator::update_scene(const std::function<void(Scene&, Camera&)>& callback) {
+    m_scheduler.restart([&] {
+        callback(m_scene, m_camera);
+        m_film.clear();
+    });
+}
 
-    int begin_tile_index = thread_index * tiles_per_thread + std::min(thread_index, threads_with_extra_tile);
-    int end_tile_index = (thread_index + 1) * tiles_per_thread + std::min(thread_index + 1, threads_with_extra_tile);
-    int current_tile_index = 0;
+void PathTracerIntegrator::restore(const std::function<void(Film&)>& callback) {
+    m_scheduler.restart([&] {
+        m_film.clear();
+        callback(m_film);
+    });
+}
 
-    int tiles_count = end_tile_index - begin_tile_index;
+bool PathTracerIntegrator::wait() {
+    return m_scheduler.wait();
+}
 
-    float4x4 projection = float4x4::perspective(radians(30.0), static_cast<double>(m_film.width) / m_film.height, 1.0, 10.0);
-    float4x4 inv_projection = inverse(projection);
+bool PathTracerIntegrator::wait_for(std::chrono::duration<double> timeout) {
+    return m_scheduler.wait_for(timeout);
+}
 
-    while (current_tile_index / tiles_count < m_samples_per_pixel) {
-        int temp = current_tile_index++;
+const Film& PathTracerIntegrator::film() const {
+    return m_film;
+}
 
-        int sample_index = temp / tiles_count;
-        int tile_index = begin_tile_index + temp % tiles_count;
+RenderStats PathTracerIntegrator::stats() const {
+    return merge_counters(m_counters.get(), m_thread_count);
+}
 
-        int tile_x = tile_index % m_film.tiles_x;
-        int tile_y = tile_index / m_film.tiles_x;
+void PathTracerIntegrator::integrate(int thread_index) {
+    assert(thread_index >= 0 && thread_index < m_thread_count);
 
-        int x_from = tile_x * TILE_SIZE;
-        int y_from = tile_y * TILE_SIZE;
+    // Seeded for every sample.
+    Random random(0);
+    RenderCounters& counters = m_counters[thread_index];
 
-        int tile_width = std::min(x_from + TILE_SIZE, m_film.width) - x_from;
-        int tile_height = std::min(y_from + TILE_SIZE, m_film.height) - y_from;
+    // Allocated once rather than on the stack of every pass, so that a film without features doesn't construct them.
+    std::unique_ptr<FeatureSample[][TILE_SIZE]> features;
+    if (m_film.aovs.features) {
+        features = std::make_unique<FeatureSample[][TILE_SIZE]>(TILE_SIZE);
+    }
 
-        float3 samples[TILE_SIZE][TILE_SIZE];
+    Trace::set_thread_name("Render thread " + std::to_string(thread_index));
 
-        for (int y = 0; y < tile_height; y++) {
-            for (int x = 0; x < tile_width; x++) {
-                float2 offset = random.rand2();
+    while (std::optional<TileWork> work = m_scheduler.pop(thread_index)) {
+        if (work->pass < PREVIEW_PASSES) {
+            // Previews are pointless once the tile has samples, which is always the case for tiles restored from a
+            // checkpoint.
+            if (m_film.has_samples(work->tile_x, work->tile_y)) {
+                continue;
+            }
 
-                double screen_x = x_from + x + offset.x;
-                double screen_y = y_from + y + offset.y;
-                
-                double normalized_x = screen_x * 2.0 / m_film.width - 1.0;
-                double normalized_y = 1.0 - screen_y * 2.0 / m_film.height;
+            TraceScope trace_scope("preview", work->tile_x, work->tile_y, work->pass);
+            auto render_start = std::chrono::steady_clock::now();
 
-                float3 origin(0.0);
-                float3 outgoing = normalize(point_transform(float3(normalized_x, normalized_y, 1.0), inv_projection));
+            render_preview(random, counters, work->tile_x, work->tile_y, work->pass - PREVIEW_PASSES, PREVIEW_BLOCK_SIZES[work->pass]);
 
-                samples[y][x] = sample_ray(random, origin, outgoing, 0, 0);
+            RenderCounters::add(counters.render_nanoseconds, std::chrono::steady_clock::now() - render_start);
+        } else {
+            if (m_film.has_pass(work->tile_x, work->tile_y, work->pass - PREVIEW_PASSES)) {
+                continue;
             }
-        }
 
-        m_film.add_samples(tile_x, tile_y, samples);
+            TraceScope trace_scope("tile pass", work->tile_x, work->tile_y, work->pass - PREVIEW_PASSES);
+            auto render_start = std::chrono::steady_clock::now();
+
+            render_tile(random, counters, work->tile_x, work->tile_y, work->pass - PREVIEW_PASSES, features.get());
+
+            RenderCounters::add(counters.render_nanoseconds, std::chrono::steady_clock::now() - render_start);
+        }
     }
 }
 
-float3 PathTracerIntegrator::sample_ray(Random& random, const float3& origin, const float3& outgoing, int diffuse_bounces, int specular_bounces) {
-    std::optional<PrimitiveHit> hit = raycast(origin, outgoing);
-    if (!hit) {
-        return float3(0.0);
-    }
+void PathTracerIntegrator::render_tile(Random& random, RenderCounters& counters, int tile_x, int tile_y, int pass, FeatureSample features[TILE_SIZE][TILE_SIZE]) {
+    assert(m_film.aovs.features == (features != nullptr));
 
-    if (hit->primitive->is_material_specular() && specular_bounces < m_max_specular_bounces) {
-        specular_bounces++;
-    } else {
-        diffuse_bounces++;
-    }
+    int x_from = tile_x * TILE_SIZE;
+    int y_from = tile_y * TILE_SIZE;
 
-    if (diffuse_bounces >= m_max_diffuse_bounces) {
-        return hit->primitive->material_emissive();
-    }
+    int tile_width = std::min(x_from + TILE_SIZE, m_film.width) - x_from;
+    int tile_height = std::min(y_from + TILE_SIZE, m_film.height) - y_from;
+
+    float3 samples[TILE_SIZE][TILE_SIZE];
+    float costs[TILE_SIZE][TILE_SIZE] = {};
 
-    float3x3 tangent_space = transpose(float3x3(hit->tangent, hit->bitangent, hit->normal));
-    float3x3 inverse_tangent_space = inverse(tangent_space);
-                        
-    float3 outgoing_tangent_space = normalize((-outgoing) * tangent_space);
-
-    if ((m_light_primitives.empty() || hit->primitive->is_material_specular() || random.rand() < 0.5)) {
-        float3 ingoing_tangent_space;
-        double material_pdf;
-        float3 bsdf = hit->primitive->material_bsdf(ingoing_tangent_space, outgoing_tangent_space, material_pdf, random.rand2());
-        if (bsdf == float3(0.0) || ingoing_tangent_space.z == 0.0 || material_pdf == 0.0) {
-            return hit->primitive->material_emissive();
+    for (int y = 0; y < tile_height; y++) {
+        if (m_scheduler.is_stopped()) {
+            return;
         }
 
-        float3 ingoing = normalize(ingoing_tangent_space * inverse_tangent_space);
+        // The end of a sample is the start of the next one, so the clock is read once per sample, and only if the
+        // film keeps costs.
+        std::chrono::steady_clock::time_point sample_start;
+        if (m_film.aovs.cost) {
+            sample_start = std::chrono::steady_clock::now();
+        }
+
+        for (int x = 0; x < tile_width; x++) {
+            uint64_t seed = sample_seed(x_from + x, y_from + y, pass, m_seed);
+            random.seed(seed);
+            float2 offset = random.rand2();
 
-        double weight = 1.0;
-        if (!m_light_primitives.empty() && !hit->primitive->is_material_specular()) {
-            double light_pdf = 0.0;
-            for (Primitive* light : m_light_primitives) {
-                light_pdf += light->geometry_pdf(hit->position, ingoing);
+            // Pixels whose ray misses keep empty features.
+            FeatureSample* pixel_features = nullptr;
+            if (features != nullptr) {
+                pixel_features = &features[y][x];
+                *pixel_features = FeatureSample();
             }
-            light_pdf /= m_light_primitives.size();
+            samples[y][x] = sample_pixel(random, counters, x_from + x + offset.x, y_from + y + offset.y, seed % RAYCAST_TIMING_INTERVAL == 0, pixel_features);
 
-            weight = sqr(material_pdf) / (sqr(material_pdf) + sqr(light_pdf));
+            if (m_film.aovs.cost) {
+                auto sample_end = std::chrono::steady_clock::now();
+                costs[y][x] = std::chrono::duration<float, std::nano>(sample_end - sample_start).count();
+                sample_start = sample_end;
+            }
         }
 
-        return hit->primitive->material_emissive() + bsdf * std::abs(ingoing_tangent_space.z) * sample_ray(random, hit->position, ingoing, diffuse_bounces, specular_bounces) * weight / material_pdf;
-    } else {
-        int light_index = static_cast<int>(random.rand() * m_light_primitives.size());
-        assert(m_light_primitives[light_index] != nullptr);
+        RenderCounters::add(counters.camera_rays, tile_width);
+    }
 
-        GeometrySample geometry_sample = m_light_primitives[light_index]->geometry_sample(random.rand2());
+    m_film.add_samples(tile_x, tile_y, pass, samples, costs, features);
+}
 
-        float3 ingoing = normalize(geometry_sample.position - hit->position);
-        float3 ingoing_tangent_space = normalize(ingoing * tangent_space);
-        if (ingoing_tangent_space.z <= 0.0) {
-            return hit->primitive->material_emissive();
-        }
+void PathTracerIntegrator::render_preview(Random& random, RenderCounters& counters, int tile_x, int tile_y, int pass, int block_size) {
+    int x_from = tile_x * TILE_SIZE;
+    int y_from = tile_y * TILE_SIZE;
+
+    int tile_width = std::min(x_from + TILE_SIZE, m_film.width) - x_from;
+    int tile_height = std::min(y_from + TILE_SIZE, m_film.height) - y_from;
+
+    float3 samples[PREVIEW_SIZE][PREVIEW_SIZE];
 
-        double material_pdf;
-        float3 bsdf = hit->primitive->material_bsdf(ingoing_tangent_space, outgoing_tangent_space, material_pdf);
-        if (bsdf == float3(0.0) || ingoing_tangent_space.z == 0.0 || material_pdf == 0.0) {
-            return hit->primitive->material_emissive();
+    for (int y = 0; y * block_size < tile_height; y++) {
+        for (int x = 0; x * block_size < tile_width; x++) {
+            uint64_t seed = sample_seed(x_from + x * block_size, y_from + y * block_size, pass, m_seed);
+            random.seed(seed);
+            float2 offset = random.rand2();
+
+            double block_width = std::min(block_size, tile_width - x * block_size);
+            double block_height = std::min(block_size, tile_height - y * block_size);
+
+            samples[y][x] = sample_pixel(random, counters, x_from + x * block_size + offset.x * block_width, y_from + y * block_size + offset.y * block_height, seed % RAYCAST_TIMING_INTERVAL == 0);
         }
 
-        double light_pdf = 0.0;
-        for (Primitive* light : m_light_primitives) {
-            light_pdf += light->geometry_pdf(hit->position, ingoing);
+        RenderCounters::add(counters.preview_rays, (tile_width + block_size - 1) / block_size);
+    }
+
+    m_film.add_preview(tile_x, tile_y, block_size, samples);
+}
+
+float3 PathTracerIntegrator::sample_pixel(Random& random, RenderCounters& counters, double screen_x, double screen_y, bool is_timed, FeatureSample* features) {
+    double normalized_x = screen_x * 2.0 / m_film.width - 1.0;
+    double normalized_y = 1.0 - screen_y * 2.0 / m_film.height;
+
+    return sample_ray(random, counters, m_camera.position(), m_camera.ray_direction(normalized_x, normalized_y), is_timed, features);
+}
+
+float3 PathTracerIntegrator::sample_ray(Random& random, RenderCounters& counters, const float3& origin, const float3& outgoing, bool is_timed, FeatureSample* features) {
+    PathState state(origin, outgoing);
+
+    int rays = 0;
+    while (true) {
+        rays++;
+
+        std::optional<SceneHit> hit = raycast(counters, state.origin, state.direction, is_timed);
+        if (hit && features != nullptr && rays == 1) {
+            *features = hit_features(*hit);
         }
-        light_pdf /= m_light_primitives.size();
 
-        double weight = sqr(light_pdf) / (sqr(material_pdf) + sqr(light_pdf));
+        if (!hit || !sample_hit(random, state, m_scene, *hit, m_max_diffuse_bounces, m_max_specular_bounces)) {
+            break;
+        }
 
-        return hit->primitive->material_emissive() + bsdf * std::abs(ingoing_tangent_space.z) * sample_ray(random, hit->position, ingoing, diffuse_bounces, specular_bounces) * weight / light_pdf;
+        RenderCounters::add(state.is_light_sample ? counters.light_rays : counters.secondary_rays, 1);
     }
+
+    counters.add_path(rays);
+
+    return state.radiance;
 }
 
-std::optional<PathTracerIntegrator::PrimitiveHit> PathTracerIntegrator::raycast(const float3& origin, const float3& direction) const {
-    std::optional<PrimitiveHit> result;
-    double length = std::numeric_limits<double>::infinity();
+std::optional<SceneHit> PathTracerIntegrator::raycast(RenderCounters& counters, const float3& origin, const float3& direction, bool is_timed) const {
+    uint64_t primitive_tests = 0;
 
-    for (const Primitive& primitive : m_primitives) {
-        std::optional<GeometryHit> hit = primitive.geometry_raycast(origin, direction, length);
-        if (hit) {
-            result = PrimitiveHit{ *hit, &primitive };
-            length = hit->distance;
-        }
+    if (!is_timed) {
+        std::optional<SceneHit> result = m_scene.raycast(origin, direction, &primitive_tests);
+        RenderCounters::add(counters.primitive_tests, primitive_tests);
+        return result;
     }
 
+    auto start = std::chrono::steady_clock::now();
+    std::optional<SceneHit> result = m_scene.raycast(origin, direction, &primitive_tests);
+    RenderCounters::add(counters.raycast_nanoseconds, (std::chrono::steady_clock::now() - start) * RAYCAST_TIMING_INTERVAL);
+
+    RenderCounters::add(counters.primitive_tests, primitive_tests);
+
     return result;
 }
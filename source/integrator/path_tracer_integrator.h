@@ -1,38 +1,67 @@
 #pragma once
 
+#include "camera.h"
 #include "film.h"
 #include "integrator/integrator.h"
+#include "integrator/path_state.h"
+#include "integrator/render_stats.h"
+#include "integrator/tile_scheduler.h"
+#include "mapped_file.h"
 #include "primitive.h"
 #include "random.h"
+#include "scene.h"
 
 #include <atomic>
+#include <memory>
 #include <thread>
 #include <vector>
 
 class PathTracerIntegrator : public Integrator {
 public:
-    PathTracerIntegrator(int width, int height, int samples_per_pixel, int max_diffuse_bounces, int max_specular_bounces, std::vector<Primitive>&& primitives);
+    // Zero `thread_count` starts a thread per hardware thread, at most one per tile. With `is_ordered` the film is
+    // bitwise the same for any number of threads, see `Film`.
+    PathTracerIntegrator(int width, int height, int samples_per_pixel, int max_diffuse_bounces, int max_specular_bounces, const Camera& camera, std::vector<Primitive>&& primitives, FilmStorage film_storage = FilmStorage::FLOAT, std::unique_ptr<MappedFile> film_file = nullptr, uint32_t seed = 0, int thread_count = 0, const FilmAovs& film_aovs = FilmAovs(), bool is_ordered = false);
     ~PathTracerIntegrator() override;
 
-    void blit(void* rgba, int pitch) override;
+    void blit(void* rgba, int pitch, std::vector<FilmRect>& dirty_rects) override;
+    void set_tone_mapping(const ToneMapping& tone_mapping) override;
+
+    void pause() override;
+    void resume() override;
+    void restart() override;
+    void set_camera(const Camera& camera) override;
+    void update_scene(const std::function<void(Scene&, Camera&)>& callback) override;
+    void restore(const std::function<void(Film&)>& callback) override;
+
+    bool wait() override;
+    bool wait_for(std::chrono::duration<double> timeout) override;
+
+    const Film& film() const override;
+    RenderStats stats() const override;
 
 private:
     void integrate(int thread_index);
 
-    struct PrimitiveHit : GeometryHit {
-        const Primitive* primitive;
-    };
+    // `features` is a tile sized scratch buffer of the thread, null unless the film keeps features.
+    void render_tile(Random& random, RenderCounters& counters, int tile_x, int tile_y, int pass, FeatureSample features[TILE_SIZE][TILE_SIZE]);
+    // Preview passes have negative numbers, counting from `-PREVIEW_PASSES`.
+    void render_preview(Random& random, RenderCounters& counters, int tile_x, int tile_y, int pass, int block_size);
 
-    float3 sample_ray(Random& random, const float3& origin, const float3& outgoing, int diffuse_bounces, int specular_bounces);
-    std::optional<PrimitiveHit> raycast(const float3& origin, const float3& direction) const;
+    // The first hit is written to `features` if it's not null. The raycasts of the path are timed if `is_timed`.
+    float3 sample_pixel(Random& random, RenderCounters& counters, double screen_x, double screen_y, bool is_timed, FeatureSample* features = nullptr);
+    float3 sample_ray(Random& random, RenderCounters& counters, const float3& origin, const float3& outgoing, bool is_timed, FeatureSample* features = nullptr);
+    std::optional<SceneHit> raycast(RenderCounters& counters, const float3& origin, const float3& direction, bool is_timed) const;
 
     Film m_film;
     int m_samples_per_pixel;
     int m_max_diffuse_bounces;
     int m_max_specular_bounces;
-    std::vector<Primitive> m_primitives;
-    std::vector<Primitive*> m_light_primitives;
+    Camera m_camera;
+    Scene m_scene;
+    uint32_t m_seed;
 
     int m_thread_count;
+    std::unique_ptr<RenderCounters[]> m_counters;
+    TileScheduler m_scheduler;
     std::vector<std::thread> m_threads;
 };
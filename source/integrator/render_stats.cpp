@@ -0,0 +1,101 @@
+#include "integrator/render_stats.h"
+
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+
+uint64_t RenderStats::rays() const {
+    return camera_rays + preview_rays + secondary_rays + light_rays;
+}
+
+RenderStats merge_counters(const RenderCounters* counters, int thread_count) {
+    assert(counters != nullptr);
+    assert(thread_count > 0);
+
+    RenderStats result;
+    result.thread_count = thread_count;
+    result.thread_render_seconds.resize(thread_count);
+
+    uint64_t render_nanoseconds = 0;
+    uint64_t raycast_nanoseconds = 0;
+
+    for (int i = 0; i < thread_count; i++) {
+        const RenderCounters& thread_counters = counters[i];
+
+        result.camera_rays += thread_counters.camera_rays.load(std::memory_order_relaxed);
+        result.preview_rays += thread_counters.preview_rays.load(std::memory_order_relaxed);
+        result.secondary_rays += thread_counters.secondary_rays.load(std::memory_order_relaxed);
+        result.light_rays += thread_counters.light_rays.load(std::memory_order_relaxed);
+        result.primitive_tests += thread_counters.primitive_tests.load(std::memory_order_relaxed);
+
+        for (int j = 0; j < PATH_LENGTH_BINS; j++) {
+            result.path_lengths[j] += thread_counters.path_lengths[j].load(std::memory_order_relaxed);
+        }
+
+        uint64_t thread_render_nanoseconds = thread_counters.render_nanoseconds.load(std::memory_order_relaxed);
+        result.thread_render_seconds[i] = thread_render_nanoseconds * 1e-9;
+
+        // Raycast time is scaled up from a sample of the paths and counted as it goes, render time only once a pass is
+        // done, so the former may come out above the latter.
+        render_nanoseconds += thread_render_nanoseconds;
+        raycast_nanoseconds += std::min(thread_counters.raycast_nanoseconds.load(std::memory_order_relaxed), thread_render_nanoseconds);
+    }
+
+    result.render_seconds = render_nanoseconds * 1e-9;
+    result.raycast_seconds = raycast_nanoseconds * 1e-9;
+    return result;
+}
+
+static std::string escape_json(const std::string& value) {
+    std::string result;
+
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+        }
+        result += c;
+    }
+
+    return result;
+}
+
+bool write_stats_json(const std::string& path, const std::string& description, const RenderStats& stats, double seconds) {
+    assert(seconds > 0.0);
+
+    std::ofstream stream(path);
+    if (!stream) {
+        return false;
+    }
+
+    stream << "{\n";
+    stream << "  \"description\": \"" << escape_json(description) << "\",\n";
+    stream << "  \"threads\": " << stats.thread_count << ",\n";
+    stream << "  \"seconds\": " << seconds << ",\n";
+    stream << "  \"camera_rays\": " << stats.camera_rays << ",\n";
+    stream << "  \"preview_rays\": " << stats.preview_rays << ",\n";
+    stream << "  \"secondary_rays\": " << stats.secondary_rays << ",\n";
+    stream << "  \"light_rays\": " << stats.light_rays << ",\n";
+    stream << "  \"rays\": " << stats.rays() << ",\n";
+    stream << "  \"primitive_tests\": " << stats.primitive_tests << ",\n";
+    stream << "  \"rays_per_second\": " << stats.rays() / seconds << ",\n";
+    stream << "  \"samples_per_second\": " << stats.camera_rays / seconds << ",\n";
+    stream << "  \"render_seconds\": " << stats.render_seconds << ",\n";
+    stream << "  \"raycast_seconds\": " << stats.raycast_seconds << ",\n";
+    stream << "  \"shading_seconds\": " << stats.render_seconds - stats.raycast_seconds << ",\n";
+
+    stream << "  \"thread_render_seconds\": [";
+    for (int i = 0; i < stats.thread_count; i++) {
+        stream << (i > 0 ? ", " : "") << stats.thread_render_seconds[i];
+    }
+    stream << "],\n";
+
+    stream << "  \"path_lengths\": [";
+    for (int i = 0; i < PATH_LENGTH_BINS; i++) {
+        stream << (i > 0 ? ", " : "") << stats.path_lengths[i];
+    }
+    stream << "]\n";
+
+    stream << "}\n";
+
+    return static_cast<bool>(stream);
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Paths of PATH_LENGTH_BINS - 1 rays or more go to the last bin.
+static constexpr int PATH_LENGTH_BINS = 16;
+
+// Counters of a single thread, written only by that thread and read by any. Every thread has its own cache line, so
+// counting costs a plain increment rather than a locked instruction and counters are merged only when reported.
+struct alignas(64) RenderCounters {
+    // Rays from the camera, rays in a direction sampled from the material and rays in a direction sampled towards a
+    // light. The latter take the place of shadow rays, the light is only hit if nothing is in the way. Camera rays of
+    // preview passes are not samples of the image and are counted apart.
+    std::atomic<uint64_t> camera_rays{ 0 };
+    std::atomic<uint64_t> preview_rays{ 0 };
+    std::atomic<uint64_t> secondary_rays{ 0 };
+    std::atomic<uint64_t> light_rays{ 0 };
+
+    std::atomic<uint64_t> primitive_tests{ 0 };
+
+    // Number of rays of every path.
+    std::atomic<uint64_t> path_lengths[PATH_LENGTH_BINS] = {};
+
+    // Time spent rendering tiles and the part of it spent in `Scene::raycast`.
+    std::atomic<uint64_t> render_nanoseconds{ 0 };
+    std::atomic<uint64_t> raycast_nanoseconds{ 0 };
+
+    // Must only be called from the thread that owns the counters.
+    static void add(std::atomic<uint64_t>& counter, uint64_t value) {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    static void add(std::atomic<uint64_t>& counter, std::chrono::steady_clock::duration duration) {
+        add(counter, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()));
+    }
+
+    void add_path(int rays) {
+        add(path_lengths[rays < PATH_LENGTH_BINS ? rays : PATH_LENGTH_BINS - 1], 1);
+    }
+};
+
+// Counters of all threads merged together.
+struct RenderStats {
+    int thread_count = 0;
+
+    uint64_t camera_rays = 0;
+    uint64_t preview_rays = 0;
+    uint64_t secondary_rays = 0;
+    uint64_t light_rays = 0;
+    uint64_t primitive_tests = 0;
+    uint64_t path_lengths[PATH_LENGTH_BINS] = {};
+
+    // Summed over the threads. The raycast time of a thread is at most its render time.
+    double render_seconds = 0.0;
+    double raycast_seconds = 0.0;
+
+    // Render time of every thread, the rest of the wall clock time a thread was idle.
+    std::vector<double> thread_render_seconds;
+
+    uint64_t rays() const;
+};
+
+RenderStats merge_counters(const RenderCounters* counters, int thread_count);
+
+// Writes the stats of a render that took `seconds` of wall clock time, along with the rates derived from them.
+// `description` identifies the render settings. Returns false if the file can't be written.
+bool write_stats_json(const std::string& path, const std::string& description, const RenderStats& stats, double seconds);
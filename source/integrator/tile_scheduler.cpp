@@ -0,0 +1,234 @@
+#include "integrator/tile_scheduler.h"
+
+#include <algorithm>
+#include <cassert>
+
+TileScheduler::TileScheduler(int thread_count, int tiles_x, int tiles_y, int passes, int band_tiles, const std::function<void(int, int)>& band_finished)
+    : thread_count(thread_count)
+    , tiles_x(tiles_x)
+    , tiles_y(tiles_y)
+    , passes(passes)
+    , band_tiles(band_tiles)
+    , m_queues(std::make_unique<WorkQueue[]>(thread_count))
+    , m_band_finished(band_finished)
+    , m_band_count((tiles_x * tiles_y + band_tiles - 1) / band_tiles)
+    , m_band(0)
+    , m_is_stopped(false)
+    , m_is_paused(false)
+    , m_is_restarting(false)
+    , m_generation(0)
+    , m_parked_threads(0)
+{
+    assert(thread_count > 0 && thread_count <= tiles_x * tiles_y);
+    assert(passes > 0);
+    assert(band_tiles > 0);
+
+    for (int i = 0; i < thread_count; i++) {
+        m_queues[i].random.seed(i + 1);
+    }
+
+    start_band(0);
+}
+
+std::optional<TileWork> TileScheduler::pop(int thread_index) {
+    while (!m_is_stopped) {
+        // Read before the flags, so that a resume or restart that happens in between is not missed by `park`.
+        int generation = m_generation;
+
+        if (std::optional<TileWork> result = try_pop(thread_index)) {
+            return result;
+        }
+
+        park(generation);
+    }
+
+    return std::nullopt;
+}
+
+std::optional<TileWork> TileScheduler::try_pop(int thread_index) {
+    assert(thread_index >= 0 && thread_index < thread_count);
+
+    if (m_is_stopped || m_is_paused || m_is_restarting) {
+        return std::nullopt;
+    }
+
+    WorkQueue& queue = m_queues[thread_index];
+
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+
+        if (!queue.items.empty() || refill(queue)) {
+            TileWork result = queue.items.front();
+            queue.items.pop_front();
+            return result;
+        }
+    }
+
+    return steal(thread_index);
+}
+
+void TileScheduler::stop() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_is_stopped = true;
+    m_condition.notify_all();
+}
+
+bool TileScheduler::is_stopped() const {
+    return m_is_stopped;
+}
+
+void TileScheduler::pause() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    m_is_paused = true;
+    m_condition.wait(lock, [&] { return m_is_stopped || m_parked_threads == thread_count; });
+}
+
+void TileScheduler::resume() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_is_paused = false;
+    m_generation++;
+    m_condition.notify_all();
+}
+
+void TileScheduler::restart(const std::function<void()>& callback) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    m_is_restarting = true;
+    m_condition.wait(lock, [&] { return m_is_stopped || m_parked_threads == thread_count; });
+
+    if (callback) {
+        callback();
+    }
+
+    start_band(0);
+
+    m_is_restarting = false;
+    m_generation++;
+    m_condition.notify_all();
+}
+
+bool TileScheduler::wait() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    m_condition.wait(lock, [&] { return m_is_stopped || is_finished(); });
+
+    return is_finished();
+}
+
+bool TileScheduler::wait_for(std::chrono::duration<double> timeout) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    m_condition.wait_for(lock, timeout, [&] { return m_is_stopped || is_finished(); });
+
+    return is_finished();
+}
+
+void TileScheduler::park(int generation) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    m_parked_threads++;
+
+    // The last thread that runs out of work in a band starts the next one.
+    if (!m_is_stopped && !m_is_paused && !m_is_restarting && m_parked_threads == thread_count && m_band + 1 < m_band_count && is_band_finished()) {
+        if (m_band_finished) {
+            m_band_finished(m_band * band_tiles, (m_band + 1) * band_tiles);
+        }
+
+        start_band(m_band + 1);
+        m_generation++;
+    }
+
+    m_condition.notify_all();
+
+    m_condition.wait(lock, [&] { return m_is_stopped || (!m_is_paused && !m_is_restarting && m_generation != generation); });
+
+    m_parked_threads--;
+}
+
+void TileScheduler::start_band(int band) {
+    assert(band >= 0 && band < m_band_count);
+
+    int begin_tile_index = band * band_tiles;
+    int tiles_total = std::min(band_tiles, tiles_x * tiles_y - begin_tile_index);
+    int tiles_per_thread = tiles_total / thread_count;
+    int threads_with_extra_tile = tiles_total % thread_count;
+
+    // Threads left without tiles in a small band steal from the others.
+    for (int i = 0; i < thread_count; i++) {
+        WorkQueue& queue = m_queues[i];
+
+        std::lock_guard<std::mutex> queue_lock(queue.mutex);
+        queue.items.clear();
+        queue.begin_tile_index = begin_tile_index + i * tiles_per_thread + std::min(i, threads_with_extra_tile);
+        queue.end_tile_index = begin_tile_index + (i + 1) * tiles_per_thread + std::min(i + 1, threads_with_extra_tile);
+        queue.next_pass = 0;
+    }
+
+    m_band = band;
+}
+
+bool TileScheduler::is_band_finished() {
+    // Threads park only after they're done with their previous pass, so once all of them are parked and no passes are
+    // left to schedule, the band is rendered.
+    if (m_is_restarting || m_parked_threads != thread_count) {
+        return false;
+    }
+
+    for (int i = 0; i < thread_count; i++) {
+        std::lock_guard<std::mutex> queue_lock(m_queues[i].mutex);
+
+        if (!m_queues[i].items.empty() || (m_queues[i].next_pass < passes && m_queues[i].begin_tile_index != m_queues[i].end_tile_index)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool TileScheduler::is_finished() {
+    return m_band + 1 == m_band_count && is_band_finished();
+}
+
+bool TileScheduler::refill(WorkQueue& queue) {
+    assert(queue.items.empty());
+
+    if (queue.next_pass >= passes || queue.begin_tile_index == queue.end_tile_index) {
+        return false;
+    }
+
+    for (int tile_index = queue.begin_tile_index; tile_index < queue.end_tile_index; tile_index++) {
+        queue.items.push_back(TileWork{ tile_index % tiles_x, tile_index / tiles_x, queue.next_pass });
+    }
+    queue.next_pass++;
+
+    return true;
+}
+
+std::optional<TileWork> TileScheduler::steal(int thread_index) {
+    if (thread_count == 1) {
+        return std::nullopt;
+    }
+
+    // Victims are visited starting from a random one, so that thieves don't pile up on the same queue.
+    int first_victim = std::uniform_int_distribution<int>(0, thread_count - 2)(m_queues[thread_index].random);
+
+    for (int i = 0; i < thread_count - 1; i++) {
+        int victim_index = (thread_index + 1 + (first_victim + i) % (thread_count - 1)) % thread_count;
+        assert(victim_index != thread_index);
+
+        WorkQueue& victim = m_queues[victim_index];
+
+        std::lock_guard<std::mutex> lock(victim.mutex);
+
+        if (!victim.items.empty() || refill(victim)) {
+            TileWork result = victim.items.back();
+            victim.items.pop_back();
+            return result;
+        }
+    }
+
+    return std::nullopt;
+}
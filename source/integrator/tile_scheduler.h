@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+
+struct TileWork {
+    int tile_x;
+    int tile_y;
+    int pass;
+};
+
+// Distributes tile passes between threads. Every thread owns a contiguous range of tiles and queues one pass of them
+// at a time. A thread that runs out of work steals passes from randomly chosen threads, so all threads stay busy until
+// the last pass is rendered.
+//
+// Threads that have nothing to do are parked inside `pop` until the scheduler is resumed, restarted or stopped, so the
+// same threads are reused for the whole lifetime of the integrator. Stop, pause and restart requests are handled
+// between two tile passes.
+//
+// Tiles are split into bands of `band_tiles` consecutive tiles in row-major order. All passes of a band are rendered
+// before the next band starts, so only the tiles of one band are accessed at a time.
+class TileScheduler {
+public:
+    // `band_finished` is called with the range of tile indices of every finished band but the last one, while all the
+    // threads are parked.
+    TileScheduler(int thread_count, int tiles_x, int tiles_y, int passes, int band_tiles, const std::function<void(int, int)>& band_finished);
+
+    // Returns the next tile pass for the given thread, or nothing when the scheduler is stopped.
+    std::optional<TileWork> pop(int thread_index);
+
+    // Same as `pop`, but returns nothing instead of parking the thread when there's no work available right now.
+    std::optional<TileWork> try_pop(int thread_index);
+
+    void stop();
+    bool is_stopped() const;
+
+    // Waits until all threads are parked, so the passes that were in flight are finished when it returns.
+    void pause();
+    void resume();
+
+    // Waits until all threads are parked, calls `callback` (which may safely modify anything the threads read) and
+    // then schedules all passes from the beginning.
+    void restart(const std::function<void()>& callback);
+
+    // Waits until all passes are rendered or the scheduler is stopped. Returns whether all passes are rendered.
+    bool wait();
+    bool wait_for(std::chrono::duration<double> timeout);
+
+    const int thread_count;
+    const int tiles_x;
+    const int tiles_y;
+    const int passes;
+    const int band_tiles;
+
+private:
+    struct alignas(64) WorkQueue {
+        std::mutex mutex;
+        std::deque<TileWork> items;
+        int begin_tile_index = 0;
+        int end_tile_index = 0;
+        int next_pass = 0;
+        std::minstd_rand random;
+    };
+
+    bool refill(WorkQueue& queue);
+    std::optional<TileWork> steal(int thread_index);
+    void park(int generation);
+
+    // Splits the tiles of the band between the threads and schedules them from the first pass.
+    void start_band(int band);
+
+    // Must be called with `m_mutex` locked.
+    bool is_band_finished();
+    bool is_finished();
+
+    std::unique_ptr<WorkQueue[]> m_queues;
+
+    std::function<void(int, int)> m_band_finished;
+    int m_band_count;
+    int m_band;
+
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::atomic<bool> m_is_stopped;
+    std::atomic<bool> m_is_paused;
+    std::atomic<bool> m_is_restarting;
+    std::atomic<int> m_generation;
+    int m_parked_threads;
+};
@@ -0,0 +1,371 @@
+#include "integrator/path_state.h"
+#include "integrator/wavefront_integrator.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cassert>
+
+WavefrontIntegrator::Wavefront::Wavefront()
+    : origins(WAVEFRONT_SIZE)
+    , directions(WAVEFRONT_SIZE)
+    , throughputs(WAVEFRONT_SIZE)
+    , radiances(WAVEFRONT_SIZE)
+    , diffuse_bounces(WAVEFRONT_SIZE)
+    , specular_bounces(WAVEFRONT_SIZE)
+    , ray_counts(WAVEFRONT_SIZE)
+    , costs(WAVEFRONT_SIZE)
+    , features(WAVEFRONT_SIZE)
+    , hits(WAVEFRONT_SIZE)
+    , randoms(WAVEFRONT_SIZE, Random(0))
+{
+    ray_queue.reserve(WAVEFRONT_SIZE);
+    hit_queue.reserve(WAVEFRONT_SIZE);
+    tiles.reserve(WAVEFRONT_TILES);
+}
+
+// Splits the time of a stage equally between the paths that took part in it.
+static void share_cost(std::vector<float>& costs, const std::vector<int>& queue, std::chrono::steady_clock::duration duration) {
+    if (queue.empty()) {
+        return;
+    }
+
+    float cost = std::chrono::duration<float, std::nano>(duration).count() / queue.size();
+    for (int path_index : queue) {
+        costs[path_index] += cost;
+    }
+}
+
+WavefrontIntegrator::WavefrontIntegrator(int width, int height, int samples_per_pixel, int max_diffuse_bounces, int max_specular_bounces, const Camera& camera, std::vector<Primitive>&& primitives, FilmStorage film_storage, std::unique_ptr<MappedFile> film_file, uint32_t seed, int thread_count, const FilmAovs& film_aovs, bool is_ordered)
+    : m_film(width, height, film_storage, std::move(film_file), film_aovs, is_ordered)
+    , m_samples_per_pixel(samples_per_pixel)
+    , m_max_diffuse_bounces(max_diffuse_bounces)
+    , m_max_specular_bounces(max_specular_bounces)
+    , m_camera(camera)
+    , m_scene(std::move(primitives))
+    , m_seed(seed)
+    , m_thread_count(std::clamp(thread_count > 0 ? thread_count : static_cast<int>(std::thread::hardware_concurrency()), 1, m_film.tiles_x * m_film.tiles_y))
+    , m_counters(std::make_unique<RenderCounters[]>(m_thread_count))
+    , m_scheduler(m_thread_count, m_film.tiles_x, m_film.tiles_y, PREVIEW_PASSES + samples_per_pixel, m_film.is_out_of_core() ? m_film.tiles_x : m_film.tiles_x * m_film.tiles_y, [this](int begin_tile_index, int end_tile_index) {
+        // Rows of tiles are rendered one after another, so that a film kept in a file only needs one of them in memory.
+        m_film.evict(begin_tile_index, end_tile_index);
+    })
+{
+    assert(m_samples_per_pixel > 0);
+    assert(m_max_diffuse_bounces > 0);
+    assert(m_max_specular_bounces >= 0);
+
+    m_threads.reserve(m_thread_count);
+    for (int i = 0; i < m_thread_count; i++) {
+        m_threads.push_back(std::thread(&WavefrontIntegrator::integrate, this, i));
+    }
+}
+
+WavefrontIntegrator::~WavefrontIntegrator() {
+    m_scheduler.stop();
+
+    for (std::thread& thread : m_threads) {
+        thread.join();
+    }
+}
+
+void WavefrontIntegrator::blit(void* rgba, int pitch, std::vector<FilmRect>& dirty_rects) {
+    m_film.blit_dirty(rgba, pitch, dirty_rects);
+}
+
+void WavefrontIntegrator::set_tone_mapping(const ToneMapping& tone_mapping) {
+    m_film.set_tone_mapping(tone_mapping);
+}
+
+void WavefrontIntegrator::pause() {
+    m_scheduler.pause();
+}
+
+void WavefrontIntegrator::resume() {
+    m_scheduler.resume();
+}
+
+void WavefrontIntegrator::restart() {
+    m_scheduler.restart([this] {
+        m_film.clear();
+    });
+}
+
+void WavefrontIntegrator::set_camera(const Camera& camera) {
+    m_scheduler.restart([&] {
+        m_camera = camera;
+        m_film.clear();
+    });
+}
+
+void WavefrontIntegrator::update_scene(const std::function<void(Scene&, Camera&)>& callback) {
+    m_scheduler.restart([&] {
+        callback(m_scene, m_camera);
+        m_film.clear();
+    });
+}
+
+void WavefrontIntegrator::restore(const std::function<void(Film&)>& callback) {
+    m_scheduler.restart([&] {
+        m_film.clear();
+        callback(m_film);
+    });
+}
+
+bool WavefrontIntegrator::wait() {
+    return m_scheduler.wait();
+}
+
+bool WavefrontIntegrator::wait_for(std::chrono::duration<double> timeout) {
+    return m_scheduler.wait_for(timeout);
+}
+
+const Film& WavefrontIntegrator::film() const {
+    return m_film;
+}
+
+RenderStats WavefrontIntegrator::stats() const {
+    return merge_counters(m_counters.get(), m_thread_count);
+}
+
+void WavefrontIntegrator::integrate(int thread_index) {
+    assert(thread_index >= 0 && thread_index < m_thread_count);
+
+    auto wavefront = std::make_unique<Wavefront>();
+    assert(wavefront != nullptr);
+
+    RenderCounters& counters = m_counters[thread_index];
+
+    Trace::set_thread_name("Render thread " + std::to_string(thread_index));
+
+    while (std::optional<TileWork> work = m_scheduler.pop(thread_index)) {
+        wavefront->tiles.clear();
+
+        do {
+            // Passes restored from a checkpoint are not rendered again, neither are previews of tiles with samples.
+            if (work->pass < PREVIEW_PASSES ? m_film.has_samples(work->tile_x, work->tile_y) : m_film.has_pass(work->tile_x, work->tile_y, work->pass - PREVIEW_PASSES)) {
+                continue;
+            }
+
+            int block_size = work->pass < PREVIEW_PASSES ? PREVIEW_BLOCK_SIZES[work->pass] : 1;
+            wavefront->tiles.push_back(WavefrontTile{ work->tile_x, work->tile_y, block_size, work->pass - PREVIEW_PASSES });
+        } while (wavefront->tiles.size() < WAVEFRONT_TILES && (work = m_scheduler.try_pop(thread_index)));
+
+        TraceScope trace_scope("wavefront");
+        auto render_start = std::chrono::steady_clock::now();
+
+        generate(*wavefront, counters);
+
+        // The whole wavefront is dropped on stop, so that shutdown doesn't wait for all of its tiles to finish.
+        while (!wavefront->ray_queue.empty() && !m_scheduler.is_stopped()) {
+            intersect(*wavefront, counters);
+            shade(*wavefront, counters);
+        }
+
+        if (m_scheduler.is_stopped()) {
+            break;
+        }
+
+        accumulate(*wavefront);
+
+        RenderCounters::add(counters.render_nanoseconds, std::chrono::steady_clock::now() - render_start);
+    }
+}
+
+void WavefrontIntegrator::generate(Wavefront& wavefront, RenderCounters& counters) const {
+    TraceScope trace_scope("generate");
+
+    wavefront.ray_queue.clear();
+
+    for (size_t i = 0; i < wavefront.tiles.size(); i++) {
+        size_t first_path = wavefront.ray_queue.size();
+
+        int x_from = wavefront.tiles[i].tile_x * TILE_SIZE;
+        int y_from = wavefront.tiles[i].tile_y * TILE_SIZE;
+
+        int tile_width = std::min(x_from + TILE_SIZE, m_film.width) - x_from;
+        int tile_height = std::min(y_from + TILE_SIZE, m_film.height) - y_from;
+
+        // Paths of a preview tile take only the first `TILE_SIZE / block_size` rows and columns of its slot.
+        int block_size = wavefront.tiles[i].block_size;
+
+        for (int y = 0; y < TILE_SIZE; y++) {
+            for (int x = 0; x < TILE_SIZE; x++) {
+                int path_index = static_cast<int>(i) * TILE_SIZE * TILE_SIZE + y * TILE_SIZE + x;
+
+                wavefront.radiances[path_index] = float3(0.0);
+                wavefront.costs[path_index] = 0.0f;
+                wavefront.features[path_index] = FeatureSample();
+
+                if (x * block_size < tile_width && y * block_size < tile_height) {
+                    Random& random = wavefront.randoms[path_index];
+                    random.seed(sample_seed(x_from + x * block_size, y_from + y * block_size, wavefront.tiles[i].pass, m_seed));
+
+                    float2 offset = random.rand2();
+
+                    double block_width = std::min(block_size, tile_width - x * block_size);
+                    double block_height = std::min(block_size, tile_height - y * block_size);
+
+                    double screen_x = x_from + x * block_size + offset.x * block_width;
+                    double screen_y = y_from + y * block_size + offset.y * block_height;
+
+                    double normalized_x = screen_x * 2.0 / m_film.width - 1.0;
+                    double normalized_y = 1.0 - screen_y * 2.0 / m_film.height;
+
+                    wavefront.origins[path_index] = m_camera.position();
+                    wavefront.directions[path_index] = m_camera.ray_direction(normalized_x, normalized_y);
+                    wavefront.throughputs[path_index] = float3(1.0);
+                    wavefront.diffuse_bounces[path_index] = 0;
+                    wavefront.specular_bounces[path_index] = 0;
+                    wavefront.ray_counts[path_index] = 0;
+
+                    wavefront.ray_queue.push_back(path_index);
+                }
+            }
+        }
+
+        RenderCounters::add(block_size == 1 ? counters.camera_rays : counters.preview_rays, wavefront.ray_queue.size() - first_path);
+    }
+}
+
+void WavefrontIntegrator::intersect(Wavefront& wavefront, RenderCounters& counters) const {
+    TraceScope trace_scope("intersect");
+
+    wavefront.hit_queue.clear();
+
+    uint64_t primitive_tests = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (int path_index : wavefront.ray_queue) {
+        wavefront.ray_counts[path_index]++;
+
+        std::optional<SceneHit> hit = m_scene.raycast(wavefront.origins[path_index], wavefront.directions[path_index], &primitive_tests);
+        if (hit) {
+            if (m_film.aovs.features && wavefront.ray_counts[path_index] == 1) {
+                wavefront.features[path_index] = hit_features(*hit);
+            }
+
+            wavefront.hits[path_index] = *hit;
+            wavefront.hit_queue.push_back(path_index);
+        } else {
+            counters.add_path(wavefront.ray_counts[path_index]);
+        }
+    }
+
+    auto duration = std::chrono::steady_clock::now() - start;
+
+    RenderCounters::add(counters.raycast_nanoseconds, duration);
+    RenderCounters::add(counters.primitive_tests, primitive_tests);
+
+    if (m_film.aovs.cost) {
+        share_cost(wavefront.costs, wavefront.ray_queue, duration);
+    }
+}
+
+void WavefrontIntegrator::shade(Wavefront& wavefront, RenderCounters& counters) const {
+    TraceScope trace_scope("shade");
+
+    auto start = std::chrono::steady_clock::now();
+
+    // Hits are grouped by material type and then by primitive, so every group is shaded without dynamic dispatch and
+    // paths that hit the same primitive keep its material and geometry in cache.
+    std::sort(wavefront.hit_queue.begin(), wavefront.hit_queue.end(), [&](int lhs, int rhs) {
+        const SceneHit& lhs_hit = wavefront.hits[lhs];
+        const SceneHit& rhs_hit = wavefront.hits[rhs];
+        if (lhs_hit.material.index() != rhs_hit.material.index()) {
+            return lhs_hit.material.index() < rhs_hit.material.index();
+        }
+        return lhs_hit.primitive != rhs_hit.primitive ? lhs_hit.primitive < rhs_hit.primitive : lhs < rhs;
+    });
+
+    wavefront.ray_queue.clear();
+
+    size_t group_begin = 0;
+    while (group_begin < wavefront.hit_queue.size()) {
+        size_t material_type = wavefront.hits[wavefront.hit_queue[group_begin]].material.index();
+
+        size_t group_end = group_begin + 1;
+        while (group_end < wavefront.hit_queue.size() && wavefront.hits[wavefront.hit_queue[group_end]].material.index() == material_type) {
+            group_end++;
+        }
+
+        std::visit([&](auto* group_material) {
+            using MaterialPointer = decltype(group_material);
+
+            for (size_t i = group_begin; i < group_end; i++) {
+                int path_index = wavefront.hit_queue[i];
+
+                const SceneHit& hit = wavefront.hits[path_index];
+                assert(std::holds_alternative<MaterialPointer>(hit.material));
+
+                PathState state(wavefront.origins[path_index], wavefront.directions[path_index]);
+                state.throughput = wavefront.throughputs[path_index];
+                state.radiance = wavefront.radiances[path_index];
+                state.diffuse_bounces = wavefront.diffuse_bounces[path_index];
+                state.specular_bounces = wavefront.specular_bounces[path_index];
+
+                const auto& material = *std::get<MaterialPointer>(hit.material);
+                Random& random = wavefront.randoms[path_index];
+                bool is_alive = sample_hit(random, state, m_scene, hit, material, m_max_diffuse_bounces, m_max_specular_bounces);
+
+                wavefront.origins[path_index] = state.origin;
+                wavefront.directions[path_index] = state.direction;
+                wavefront.throughputs[path_index] = state.throughput;
+                wavefront.radiances[path_index] = state.radiance;
+                wavefront.diffuse_bounces[path_index] = state.diffuse_bounces;
+                wavefront.specular_bounces[path_index] = state.specular_bounces;
+
+                if (is_alive) {
+                    RenderCounters::add(state.is_light_sample ? counters.light_rays : counters.secondary_rays, 1);
+                    wavefront.ray_queue.push_back(path_index);
+                } else {
+                    counters.add_path(wavefront.ray_counts[path_index]);
+                }
+            }
+        }, wavefront.hits[wavefront.hit_queue[group_begin]].material);
+
+        group_begin = group_end;
+    }
+
+    if (m_film.aovs.cost) {
+        share_cost(wavefront.costs, wavefront.hit_queue, std::chrono::steady_clock::now() - start);
+    }
+}
+
+void WavefrontIntegrator::accumulate(Wavefront& wavefront) {
+    TraceScope trace_scope("accumulate");
+
+    for (size_t i = 0; i < wavefront.tiles.size(); i++) {
+        const WavefrontTile& tile = wavefront.tiles[i];
+        const float3* radiances = wavefront.radiances.data() + i * TILE_SIZE * TILE_SIZE;
+
+        if (tile.block_size == 1) {
+            const float* path_costs = wavefront.costs.data() + i * TILE_SIZE * TILE_SIZE;
+            const FeatureSample* path_features = wavefront.features.data() + i * TILE_SIZE * TILE_SIZE;
+
+            float3 samples[TILE_SIZE][TILE_SIZE];
+            float costs[TILE_SIZE][TILE_SIZE];
+            FeatureSample features[TILE_SIZE][TILE_SIZE];
+
+            for (int y = 0; y < TILE_SIZE; y++) {
+                for (int x = 0; x < TILE_SIZE; x++) {
+                    samples[y][x] = radiances[y * TILE_SIZE + x];
+                    costs[y][x] = path_costs[y * TILE_SIZE + x];
+                    features[y][x] = path_features[y * TILE_SIZE + x];
+                }
+            }
+
+            m_film.add_samples(tile.tile_x, tile.tile_y, tile.pass, samples, costs, features);
+        } else {
+            float3 samples[PREVIEW_SIZE][PREVIEW_SIZE];
+
+            for (int y = 0; y < PREVIEW_SIZE; y++) {
+                for (int x = 0; x < PREVIEW_SIZE; x++) {
+                    samples[y][x] = radiances[y * TILE_SIZE + x];
+                }
+            }
+
+            m_film.add_preview(tile.tile_x, tile.tile_y, tile.block_size, samples);
+        }
+    }
+}
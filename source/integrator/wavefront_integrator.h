@@ -0,0 +1,103 @@
+#pragma once
+
+#include "camera.h"
+#include "film.h"
+#include "integrator/integrator.h"
+#include "integrator/render_stats.h"
+#include "integrator/tile_scheduler.h"
+#include "mapped_file.h"
+#include "primitive.h"
+#include "random.h"
+#include "scene.h"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Number of tile passes that are traced together in one wavefront.
+static constexpr int WAVEFRONT_TILES = 8;
+
+class WavefrontIntegrator : public Integrator {
+public:
+    // Zero `thread_count` starts a thread per hardware thread, at most one per tile. With `is_ordered` the film is
+    // bitwise the same for any number of threads, see `Film`.
+    WavefrontIntegrator(int width, int height, int samples_per_pixel, int max_diffuse_bounces, int max_specular_bounces, const Camera& camera, std::vector<Primitive>&& primitives, FilmStorage film_storage = FilmStorage::FLOAT, std::unique_ptr<MappedFile> film_file = nullptr, uint32_t seed = 0, int thread_count = 0, const FilmAovs& film_aovs = FilmAovs(), bool is_ordered = false);
+    ~WavefrontIntegrator() override;
+
+    void blit(void* rgba, int pitch, std::vector<FilmRect>& dirty_rects) override;
+    void set_tone_mapping(const ToneMapping& tone_mapping) override;
+
+    void pause() override;
+    void resume() override;
+    void restart() override;
+    void set_camera(const Camera& camera) override;
+    void update_scene(const std::function<void(Scene&, Camera&)>& callback) override;
+    void restore(const std::function<void(Film&)>& callback) override;
+
+    bool wait() override;
+    bool wait_for(std::chrono::duration<double> timeout) override;
+
+    const Film& film() const override;
+    RenderStats stats() const override;
+
+private:
+    static constexpr int WAVEFRONT_SIZE = WAVEFRONT_TILES * TILE_SIZE * TILE_SIZE;
+
+    struct WavefrontTile {
+        int tile_x;
+        int tile_y;
+        int block_size;
+
+        // Full resolution pass, previews have negative numbers counting from `-PREVIEW_PASSES`.
+        int pass;
+    };
+
+    // Path states in structure of arrays layout. Queues contain indices of the paths that take part in the next stage.
+    struct Wavefront {
+        Wavefront();
+
+        std::vector<float3> origins;
+        std::vector<float3> directions;
+        std::vector<float3> throughputs;
+        std::vector<float3> radiances;
+        std::vector<int> diffuse_bounces;
+        std::vector<int> specular_bounces;
+        std::vector<int> ray_counts;
+
+        // Time spent on the paths, only tracked for films with the cost AOV. Every path gets an equal share of the time
+        // of the stages it takes part in.
+        std::vector<float> costs;
+
+        // First hits of the paths, only tracked for films with the feature AOV.
+        std::vector<FeatureSample> features;
+        std::vector<SceneHit> hits;
+
+        std::vector<int> ray_queue;
+        std::vector<int> hit_queue;
+
+        std::vector<WavefrontTile> tiles;
+
+        // Every path draws from its own generator, seeded by its pixel and pass like the samples of the path tracer.
+        std::vector<Random> randoms;
+    };
+
+    void integrate(int thread_index);
+
+    void generate(Wavefront& wavefront, RenderCounters& counters) const;
+    void intersect(Wavefront& wavefront, RenderCounters& counters) const;
+    void shade(Wavefront& wavefront, RenderCounters& counters) const;
+    void accumulate(Wavefront& wavefront);
+
+    Film m_film;
+    int m_samples_per_pixel;
+    int m_max_diffuse_bounces;
+    int m_max_specular_bounces;
+    Camera m_camera;
+    Scene m_scene;
+    uint32_t m_seed;
+
+    int m_thread_count;
+    std::unique_ptr<RenderCounters[]> m_counters;
+    TileScheduler m_scheduler;
+    std::vector<std::thread> m_threads;
+};
@@ -1,13 +1,20 @@
-#include "geometry/box_geometry.h"
-#include "geometry/sphere_geometry.h"
+#include "camera.h"
+#include "denoiser.h"
+#include "file_watcher.h"
 #include "integrator/path_tracer_integrator.h"
-#include "material/diffuse_material.h"
-#include "material/emissive_material.h"
-#include "material/specular_reflective_material.h"
-#include "material/specular_transmissive_material.h"
-#include "primitive.h"
+#include "integrator/wavefront_integrator.h"
+#include "scenes/cornell_box.h"
+#include "scenes/scene_file.h"
+#include "trace.h"
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
 #include <SDL2/SDL.h>
 
 constexpr int WINDOW_WIDTH = 1024;
@@ -17,100 +24,163 @@ constexpr int TEXTURE_HEIGHT = 1024;
 constexpr int SAMPLES_PER_PIXEL = 1024;
 constexpr int DIFFUSE_BOUNCES_MAX = 4;
 constexpr int SPECULAR_BOUNCES_MAX = 4;
+constexpr double CAMERA_MOVE_SPEED = 0.5;
+constexpr double CAMERA_ROTATE_SPEED = radians(0.2);
+constexpr double CAMERA_ZOOM_SPEED = radians(2.0);
+constexpr double CAMERA_FOV_MIN = radians(5.0);
+constexpr double CAMERA_FOV_MAX = radians(120.0);
+constexpr double EXPOSURE_STEP = 0.5;
 
-static std::vector<Primitive> build_scene() {
-    auto long_wall_geometry = std::make_shared<BoxGeometry>(float3(0.5, 0.5, 1.5));
-    assert(long_wall_geometry != nullptr);
-    
-    auto short_wall_geometry = std::make_shared<BoxGeometry>(float3(0.5));
-    assert(short_wall_geometry != nullptr);
-
-    auto top_side_geometry = std::make_shared<BoxGeometry>(float3(0.2, 0.5, 1.5));
-    assert(top_side_geometry != nullptr);
-
-    auto top_front_geometry = std::make_shared<BoxGeometry>(float3(0.1, 0.5, 0.2));
-    assert(top_front_geometry != nullptr);
-
-    auto top_back_geometry = std::make_shared<BoxGeometry>(float3(0.1, 0.5, 1.2));
-    assert(top_back_geometry != nullptr);
-    
-    auto lamp_geometry = std::make_shared<BoxGeometry>(float3(0.1));
-    assert(lamp_geometry != nullptr);
-
-    auto left_box_geometry = std::make_shared<BoxGeometry>(float3(0.15, 0.275, 0.15));
-    assert(left_box_geometry != nullptr);
-
-    auto right_box_geometry = std::make_shared<BoxGeometry>(float3(0.15));
-    assert(right_box_geometry != nullptr);
-
-    auto sphere_geometry = std::make_shared<SphereGeometry>(0.15);
-    assert(sphere_geometry != nullptr);
-
-    auto red_material = std::make_shared<DiffuseMaterial>(float3(1.0, 0.0, 0.0));
-    assert(red_material != nullptr);
-    
-    auto green_material = std::make_shared<DiffuseMaterial>(float3(0.0, 1.0, 0.0));
-    assert(green_material != nullptr);
-    
-    auto white_material = std::make_shared<DiffuseMaterial>(float3(1.0));
-    assert(white_material != nullptr);
-
-    auto emissive_material = std::make_shared<EmissiveMaterial>(float3(15.0));
-    assert(emissive_material != nullptr);
-
-    auto reflective_material = std::make_shared<SpecularReflectiveMaterial>(10.0);
-    assert(reflective_material != nullptr);
-
-    auto transmissive_material = std::make_shared<SpecularTransmissiveMaterial>(2.5);
-    assert(transmissive_material != nullptr);
-
-    float4x4 left_box_transform = float4x4::rotation(float3(0.0, 1.0, 0.0), radians(-20.0)) * float4x4::translation(float3(-0.175, -0.225, 2.5));
-    float4x4 right_box_transform = float4x4::rotation(float3(0.0, 1.0, 0.0), radians(20.0)) * float4x4::translation(float3(0.175, -0.35, 2.3));
-
-    return std::vector<Primitive> {
-        { long_wall_geometry,  red_material,   float4x4::translation(float3(-1.0, 0.0, 1.4))  }, // left wall
-        { long_wall_geometry,  green_material, float4x4::translation(float3(1.0, 0.0, 1.4))   }, // right wall
-        { long_wall_geometry,  white_material, float4x4::translation(float3(0.0, -1.0, 1.4))  }, // bottom wall
-        { short_wall_geometry, white_material, float4x4::translation(float3(0.0, 0.0, 3.4))   }, // front wall
-        { short_wall_geometry, white_material, float4x4::translation(float3(0.0, 0.0, -0.6))  }, // back wall
-        { top_side_geometry,   white_material, float4x4::translation(float3(-0.3, 1.0, 1.4))  }, // top left wall
-        { top_side_geometry,   white_material, float4x4::translation(float3(0.3, 1.0, 1.4))   }, // top right wall
-        { top_front_geometry,  white_material, float4x4::translation(float3(0.0, 1.0, 2.7))   }, // top front wall
-        { top_back_geometry,   white_material, float4x4::translation(float3(0.0, 1.0, 1.1))   }, // top back wall
-
-        { left_box_geometry,  white_material, left_box_transform  }, // left box
-        { right_box_geometry, white_material, right_box_transform }, // right box
-
-        //{ sphere_geometry, reflective_material, float4x4::translation(float3(-0.175, -0.35, 2.5)) }, // left sphere
-        //{ sphere_geometry, reflective_material, float4x4::translation(float3(0.175, -0.35, 2.3)) }, // right sphere
-
-        //{ sphere_geometry, transmissive_material, float4x4::translation(float3(-0.175, -0.35, 2.5)) }, // left sphere
-        //{ sphere_geometry, transmissive_material, float4x4::translation(float3(0.175, -0.35, 2.3)) }, // right sphere
-
-        { lamp_geometry, emissive_material, float4x4::translation(float3(0.0, 0.61, 2.4)) }, // lamp
-    };
-}
+// Frames per second the window is updated at, can be overridden with `--refresh-rate`.
+constexpr int DISPLAY_REFRESH_RATE = 30;
+
+// Seconds between updates of the render stats in the window title and of the cost heatmap.
+constexpr double STATS_INTERVAL = 0.5;
+
+// The heatmap is scaled to this percentile of the pixel costs, so that a few outliers don't wash it out.
+constexpr double HEATMAP_PERCENTILE = 99.0;
+
+// Seconds between refreshes of the denoised view, denoising the whole window stalls it for a moment.
+constexpr double DENOISE_INTERVAL = 2.0;
 
-static bool poll_events() {
+static bool poll_events(Integrator* integrator, Camera& camera, ToneMapping& tone_mapping, bool& is_camera_changed, bool& is_paused, bool& is_exposed, bool& is_heatmap, bool& is_denoised) {
     SDL_Event sdl_event;
     while (SDL_PollEvent(&sdl_event) != 0) {
         if (sdl_event.type == SDL_QUIT) {
             return false;
         }
+
+        if (sdl_event.type == SDL_WINDOWEVENT && sdl_event.window.event == SDL_WINDOWEVENT_EXPOSED) {
+            is_exposed = true;
+        }
+
+        if (sdl_event.type == SDL_MOUSEMOTION && (sdl_event.motion.state & SDL_BUTTON_LMASK) != 0) {
+            camera.set_rotation(camera.yaw() + sdl_event.motion.xrel * CAMERA_ROTATE_SPEED, camera.pitch() - sdl_event.motion.yrel * CAMERA_ROTATE_SPEED);
+            is_camera_changed = true;
+        }
+
+        if (sdl_event.type == SDL_MOUSEWHEEL && sdl_event.wheel.y != 0) {
+            camera.set_fov(clamp(camera.fov() - sdl_event.wheel.y * CAMERA_ZOOM_SPEED, CAMERA_FOV_MIN, CAMERA_FOV_MAX));
+            is_camera_changed = true;
+        }
+
+        if (sdl_event.type == SDL_KEYDOWN && sdl_event.key.repeat == 0) {
+            if (sdl_event.key.keysym.sym == SDLK_SPACE) {
+                if (is_paused) {
+                    integrator->resume();
+                } else {
+                    integrator->pause();
+                }
+                is_paused = !is_paused;
+            } else if (sdl_event.key.keysym.sym == SDLK_r) {
+                integrator->restart();
+            } else if (sdl_event.key.keysym.sym == SDLK_EQUALS || sdl_event.key.keysym.sym == SDLK_MINUS) {
+                tone_mapping.exposure += sdl_event.key.keysym.sym == SDLK_EQUALS ? EXPOSURE_STEP : -EXPOSURE_STEP;
+                integrator->set_tone_mapping(tone_mapping);
+            } else if (sdl_event.key.keysym.sym == SDLK_t) {
+                tone_mapping.tone_operator = static_cast<ToneMappingOperator>((static_cast<int>(tone_mapping.tone_operator) + 1) % static_cast<int>(ToneMappingOperator::COUNT));
+                integrator->set_tone_mapping(tone_mapping);
+            } else if (sdl_event.key.keysym.sym == SDLK_c && integrator->film().aovs.cost) {
+                is_heatmap = !is_heatmap;
+                is_denoised = false;
+            } else if (sdl_event.key.keysym.sym == SDLK_n && integrator->film().aovs.features) {
+                is_denoised = !is_denoised;
+                is_heatmap = false;
+            }
+        }
     }
     return true;
 }
 
-static void blit(Integrator* integrator, SDL_Texture* texture) {
-    void* data;
-    int pitch;
+static bool move_camera(Camera& camera, double elapsed) {
+    const Uint8* keys = SDL_GetKeyboardState(NULL);
+    assert(keys != nullptr);
 
-    int lock_texture = SDL_LockTexture(texture, NULL, &data, &pitch);
-    assert(lock_texture == 0);
+    float3 direction(0.0);
+    if (keys[SDL_SCANCODE_W]) {
+        direction += camera.forward();
+    }
+    if (keys[SDL_SCANCODE_S]) {
+        direction -= camera.forward();
+    }
+    if (keys[SDL_SCANCODE_D]) {
+        direction += camera.right();
+    }
+    if (keys[SDL_SCANCODE_A]) {
+        direction -= camera.right();
+    }
+    if (keys[SDL_SCANCODE_E]) {
+        direction += float3(0.0, 1.0, 0.0);
+    }
+    if (keys[SDL_SCANCODE_Q]) {
+        direction -= float3(0.0, 1.0, 0.0);
+    }
 
-    integrator->blit(data, pitch);
+    if (equal(direction, 0.0)) {
+        return false;
+    }
 
-    SDL_UnlockTexture(texture);
+    camera.set_position(camera.position() + normalize(direction) * CAMERA_MOVE_SPEED * elapsed);
+    return true;
+}
+
+// Uploads only the tiles that changed since the previous frame. Returns whether anything was uploaded.
+static bool blit(Integrator* integrator, SDL_Texture* texture, std::vector<Uint32>& pixels, std::vector<FilmRect>& dirty_rects) {
+    int pitch = TEXTURE_WIDTH * sizeof(Uint32);
+
+    dirty_rects.clear();
+    integrator->blit(pixels.data(), pitch, dirty_rects);
+
+    for (const FilmRect& dirty_rect : dirty_rects) {
+        SDL_Rect rect{ dirty_rect.x, dirty_rect.y, dirty_rect.width, dirty_rect.height };
+
+        int update_texture = SDL_UpdateTexture(texture, &rect, pixels.data() + static_cast<size_t>(rect.y) * TEXTURE_WIDTH + rect.x, pitch);
+        assert(update_texture == 0);
+    }
+
+    return !dirty_rects.empty();
+}
+
+// Uploads the whole film, after the texture was showing something else.
+static void blit_all(Integrator* integrator, SDL_Texture* texture, std::vector<Uint32>& pixels) {
+    int pitch = TEXTURE_WIDTH * sizeof(Uint32);
+
+    integrator->film().blit(pixels.data(), pitch);
+
+    int update_texture = SDL_UpdateTexture(texture, NULL, pixels.data(), pitch);
+    assert(update_texture == 0);
+}
+
+// Uploads the mean cost per sample of every pixel as a false color heatmap.
+static void blit_heatmap(Integrator* integrator, SDL_Texture* texture, std::vector<float>& costs, std::vector<Uint32>& pixels) {
+    int pitch = TEXTURE_WIDTH * sizeof(Uint32);
+    int count = TEXTURE_WIDTH * TEXTURE_HEIGHT;
+
+    integrator->film().resolve_cost(costs.data());
+    heatmap(costs.data(), count, percentile(costs.data(), count, HEATMAP_PERCENTILE), pixels.data());
+
+    int update_texture = SDL_UpdateTexture(texture, NULL, pixels.data(), pitch);
+    assert(update_texture == 0);
+}
+
+// Uploads the denoised film, tone mapped the same way as the render.
+static void blit_denoised(Integrator* integrator, SDL_Texture* texture, const ToneMapping& tone_mapping, int thread_count, std::vector<float>& denoised, std::vector<Uint32>& pixels) {
+    int pitch = TEXTURE_WIDTH * sizeof(Uint32);
+    int count = TEXTURE_WIDTH * TEXTURE_HEIGHT;
+
+    DenoiserOptions options;
+    options.thread_count = thread_count;
+
+    auto start = std::chrono::steady_clock::now();
+    denoise_film(integrator->film(), denoised.data(), options);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::printf("Denoised in %.1f ms, %.1f ms per megapixel\n", seconds * 1e3, seconds * 1e3 / (count * 1e-6));
+
+    tone_map(tone_mapping, denoised.data(), nullptr, count, pixels.data());
+
+    int update_texture = SDL_UpdateTexture(texture, NULL, pixels.data(), pitch);
+    assert(update_texture == 0);
 }
 
 static void present(SDL_Renderer* renderer, SDL_Texture* texture) {
@@ -120,6 +190,76 @@ static void present(SDL_Renderer* renderer, SDL_Texture* texture) {
     SDL_RenderPresent(renderer);
 }
 
+// Shows the rates since the previous update in the window title.
+static void update_title(SDL_Window* window, const RenderStats& stats, const RenderStats& last_stats, double elapsed) {
+    double render_seconds = stats.render_seconds - last_stats.render_seconds;
+    double raycast_seconds = std::min(stats.raycast_seconds - last_stats.raycast_seconds, render_seconds);
+
+    char title[128];
+    std::snprintf(title, sizeof(title), "Path Tracer - %.2f Mrays/s, %.2f Msamples/s, %.0f%% raycast", (stats.rays() - last_stats.rays()) / elapsed * 1e-6,
+        (stats.camera_rays - last_stats.camera_rays) / elapsed * 1e-6, render_seconds > 0.0 ? raycast_seconds / render_seconds * 100.0 : 0.0);
+
+    SDL_SetWindowTitle(window, title);
+}
+
+// Applies the edits of the scene file to the live scene. Only the primitives that changed are replaced, unless
+// primitives were added or removed or changed their geometry. An invalid file leaves the scene as it is. Edits of the
+// width, height or samples per pixel are reported and ignored, the window has a fixed size and the samples per pixel
+// are only read at startup.
+static void reload_scene(Integrator* integrator, const char* path, SceneFile& scene, Camera& camera) {
+    Uint64 start_counter = SDL_GetPerformanceCounter();
+
+    SceneFile edited;
+    std::string error;
+    if (!load_scene_file(path, edited, error)) {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return;
+    }
+
+    SceneFileDiff diff = diff_scene_files(scene, edited);
+
+    if (diff.is_image_changed) {
+        std::fprintf(stderr, "Edits of the width, height or samples per pixel of %s don't apply to a running render\n", path);
+
+        // The scene keeps the settings of the render, so that the edit is reported until it's applied.
+        edited.settings.width = scene.settings.width;
+        edited.settings.height = scene.settings.height;
+        edited.settings.samples_per_pixel = scene.settings.samples_per_pixel;
+    }
+
+    if (diff.is_camera_changed) {
+        camera.set_position(edited.settings.camera_position);
+        camera.set_rotation(edited.settings.camera_yaw, edited.settings.camera_pitch);
+        camera.set_fov(edited.settings.camera_fov);
+    }
+
+    // The camera and the primitives are updated together, so that the render restarts once.
+    if (!diff.is_empty()) {
+        integrator->update_scene([&](Scene& live, Camera& live_camera) {
+            live_camera = camera;
+
+            if (diff.is_rebuilt) {
+                live = Scene(std::move(edited.primitives));
+            } else {
+                for (size_t index : diff.changed_primitives) {
+                    live.replace_primitive(index, edited.primitives[index]);
+                }
+            }
+        });
+    }
+
+    double seconds = static_cast<double>(SDL_GetPerformanceCounter() - start_counter) / SDL_GetPerformanceFrequency();
+    if (diff.is_rebuilt) {
+        std::printf("Reloaded %s in %.3f s, rebuilt the scene with %zu primitives\n", path, seconds, edited.sources.size());
+    } else {
+        std::printf("Reloaded %s in %.3f s, replaced %zu primitives%s\n", path, seconds, diff.changed_primitives.size(), diff.is_camera_changed ? " and moved the camera" : "");
+    }
+
+    // Only what the primitives were made of is kept to compare with the next edit.
+    edited.primitives = std::vector<Primitive>();
+    scene = std::move(edited);
+}
+
 int main(int arc, char* argv[]) {
     int init = SDL_Init(SDL_INIT_VIDEO);
     assert(init == 0);
@@ -133,12 +273,179 @@ int main(int arc, char* argv[]) {
     SDL_Texture* texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, TEXTURE_WIDTH, TEXTURE_HEIGHT);
     assert(texture != nullptr);
 
-    auto integrator = std::make_unique<PathTracerIntegrator>(TEXTURE_WIDTH, TEXTURE_HEIGHT, SAMPLES_PER_PIXEL, DIFFUSE_BOUNCES_MAX, SPECULAR_BOUNCES_MAX, build_scene());
+    bool is_wavefront = false;
+    int refresh_rate = DISPLAY_REFRESH_RATE;
+
+    // Zero for a thread per hardware thread.
+    int thread_count = 0;
+
+    // Empty if the render is not traced.
+    const char* trace_path = "";
+
+    FilmAovs film_aovs;
+
+    // Empty for the Cornell box.
+    const char* scene_path = "";
+
+    for (int i = 1; i < arc; i++) {
+        if (std::strcmp(argv[i], "--wavefront") == 0) {
+            is_wavefront = true;
+        } else if (std::strcmp(argv[i], "--refresh-rate") == 0 && i + 1 < arc) {
+            refresh_rate = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < arc) {
+            thread_count = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < arc) {
+            trace_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--scene-file") == 0 && i + 1 < arc) {
+            scene_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--cost") == 0) {
+            film_aovs.cost = true;
+        } else if (std::strcmp(argv[i], "--denoise") == 0) {
+            film_aovs.features = true;
+        }
+    }
+    assert(refresh_rate > 0);
+    assert(thread_count >= 0);
+
+    if (*trace_path != '\0') {
+        Trace::start();
+        Trace::set_thread_name("Main thread");
+    }
+
+    // The window size doesn't change, only the camera and the samples per pixel of a scene file are used.
+    SceneFile scene;
+    if (*scene_path != '\0') {
+        std::string error;
+        if (!load_scene_file(scene_path, scene, error)) {
+            std::fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        std::printf("Loaded %zu primitives from %s in %.3f s\n", scene.primitives.size(), scene_path, scene.read_seconds + scene.parse_seconds);
+    } else {
+        scene.primitives = build_cornell_box();
+    }
+
+    // Null for the Cornell box, or if the scene file can't be watched.
+    std::unique_ptr<FileWatcher> watcher;
+    if (*scene_path != '\0') {
+        watcher = FileWatcher::watch(scene_path);
+        if (watcher == nullptr) {
+            std::fprintf(stderr, "Failed to watch %s, edits won't be reloaded\n", scene_path);
+        }
+    }
+
+    int samples_per_pixel = scene.settings.samples_per_pixel > 0 ? scene.settings.samples_per_pixel : SAMPLES_PER_PIXEL;
+
+    Camera camera(static_cast<double>(TEXTURE_WIDTH) / TEXTURE_HEIGHT, scene.settings.camera_fov);
+    camera.set_position(scene.settings.camera_position);
+    camera.set_rotation(scene.settings.camera_yaw, scene.settings.camera_pitch);
+
+    std::unique_ptr<Integrator> integrator;
+    if (is_wavefront) {
+        integrator = std::make_unique<WavefrontIntegrator>(TEXTURE_WIDTH, TEXTURE_HEIGHT, samples_per_pixel, DIFFUSE_BOUNCES_MAX, SPECULAR_BOUNCES_MAX, camera, std::move(scene.primitives), FilmStorage::FLOAT, nullptr, 0, thread_count, film_aovs);
+    } else {
+        integrator = std::make_unique<PathTracerIntegrator>(TEXTURE_WIDTH, TEXTURE_HEIGHT, samples_per_pixel, DIFFUSE_BOUNCES_MAX, SPECULAR_BOUNCES_MAX, camera, std::move(scene.primitives), FilmStorage::FLOAT, nullptr, 0, thread_count, film_aovs);
+    }
     assert(integrator != nullptr);
 
-    while (poll_events()) {
-        blit(integrator.get(), texture);
-        present(renderer, texture);
+    ToneMapping tone_mapping;
+
+    std::vector<Uint32> pixels(static_cast<size_t>(TEXTURE_WIDTH) * TEXTURE_HEIGHT);
+    std::vector<FilmRect> dirty_rects;
+
+    // Only allocated when the film keeps costs.
+    std::vector<float> costs(film_aovs.cost ? pixels.size() : 0);
+
+    // Only allocated when the film keeps features.
+    std::vector<float> denoised(film_aovs.features ? pixels.size() * 3 : 0);
+
+    bool is_paused = false;
+    bool is_heatmap = false;
+    bool is_denoised = false;
+    Uint64 last_counter = SDL_GetPerformanceCounter();
+    Uint64 frame_counters = SDL_GetPerformanceFrequency() / refresh_rate;
+
+    RenderStats last_stats = integrator->stats();
+    Uint64 last_stats_counter = last_counter;
+    Uint64 last_denoise_counter = last_counter;
+
+    while (true) {
+        bool is_camera_changed = false;
+        bool is_exposed = false;
+        bool was_heatmap = is_heatmap;
+        bool was_denoised = is_denoised;
+        if (!poll_events(integrator.get(), camera, tone_mapping, is_camera_changed, is_paused, is_exposed, is_heatmap, is_denoised)) {
+            break;
+        }
+
+        Uint64 counter = SDL_GetPerformanceCounter();
+        double elapsed = static_cast<double>(counter - last_counter) / SDL_GetPerformanceFrequency();
+        last_counter = counter;
+
+        if (move_camera(camera, elapsed)) {
+            is_camera_changed = true;
+        }
+
+        if (is_camera_changed) {
+            integrator->set_camera(camera);
+        }
+
+        if (watcher != nullptr && watcher->has_changed()) {
+            reload_scene(integrator.get(), scene_path, scene, camera);
+        }
+
+        double stats_elapsed = static_cast<double>(counter - last_stats_counter) / SDL_GetPerformanceFrequency();
+
+        if (is_heatmap) {
+            // The heatmap is resolved from the whole film, so it is only refreshed with the stats.
+            if (!was_heatmap || stats_elapsed >= STATS_INTERVAL) {
+                blit_heatmap(integrator.get(), texture, costs, pixels);
+                present(renderer, texture);
+            } else if (is_exposed) {
+                present(renderer, texture);
+            }
+        } else if (is_denoised) {
+            // Denoising takes much longer than a frame, the denoised view is refreshed less often than the heatmap.
+            double denoise_elapsed = static_cast<double>(counter - last_denoise_counter) / SDL_GetPerformanceFrequency();
+            if (!was_denoised || denoise_elapsed >= DENOISE_INTERVAL) {
+                blit_denoised(integrator.get(), texture, tone_mapping, thread_count, denoised, pixels);
+                present(renderer, texture);
+                last_denoise_counter = SDL_GetPerformanceCounter();
+            } else if (is_exposed) {
+                present(renderer, texture);
+            }
+        } else {
+            if (was_heatmap || was_denoised) {
+                blit_all(integrator.get(), texture, pixels);
+                is_exposed = true;
+            }
+
+            // Nothing is presented until the film changes, unless the window contents were lost.
+            if (blit(integrator.get(), texture, pixels, dirty_rects) || is_exposed) {
+                present(renderer, texture);
+            }
+        }
+
+        if (stats_elapsed >= STATS_INTERVAL) {
+            RenderStats stats = integrator->stats();
+            update_title(window, stats, last_stats, stats_elapsed);
+
+            last_stats = stats;
+            last_stats_counter = counter;
+        }
+
+        // The workers get the rest of the frame.
+        Uint64 frame_elapsed = SDL_GetPerformanceCounter() - counter;
+        if (frame_elapsed < frame_counters) {
+            SDL_Delay(static_cast<Uint32>((frame_counters - frame_elapsed) * 1000 / SDL_GetPerformanceFrequency()));
+        }
+    }
+
+    // The render threads are stopped first, so that they don't record while the trace is written.
+    integrator.reset();
+
+    if (*trace_path != '\0' && !Trace::write(trace_path)) {
+        std::fprintf(stderr, "Failed to write %s\n", trace_path);
     }
 
     SDL_DestroyTexture(texture);
@@ -0,0 +1,147 @@
+#include "mapped_file.h"
+
+#include <cassert>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+std::unique_ptr<MappedFile> MappedFile::open(const std::string& path, size_t size) {
+    return map(path, size, false);
+}
+
+std::unique_ptr<MappedFile> MappedFile::create(const std::string& path, size_t size) {
+    return map(path, size, true);
+}
+
+#ifdef _WIN32
+
+std::unique_ptr<MappedFile> MappedFile::map(const std::string& path, size_t size, bool is_truncated) {
+    assert(size > 0);
+
+    std::unique_ptr<MappedFile> result(new MappedFile());
+
+    DWORD disposition = is_truncated ? CREATE_ALWAYS : OPEN_ALWAYS;
+    result->m_file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, disposition, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (result->m_file == INVALID_HANDLE_VALUE) {
+        result->m_file = nullptr;
+        return nullptr;
+    }
+
+    LARGE_INTEGER file_size;
+    file_size.QuadPart = static_cast<LONGLONG>(size);
+    if (!SetFilePointerEx(result->m_file, file_size, NULL, FILE_BEGIN) || !SetEndOfFile(result->m_file)) {
+        return nullptr;
+    }
+
+    result->m_mapping = CreateFileMappingA(result->m_file, NULL, PAGE_READWRITE, static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), NULL);
+    if (result->m_mapping == nullptr) {
+        return nullptr;
+    }
+
+    result->m_data = MapViewOfFile(result->m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (result->m_data == nullptr) {
+        return nullptr;
+    }
+
+    result->m_size = size;
+    return result;
+}
+
+MappedFile::~MappedFile() {
+    if (m_data != nullptr) {
+        UnmapViewOfFile(m_data);
+    }
+    if (m_mapping != nullptr) {
+        CloseHandle(m_mapping);
+    }
+    if (m_file != nullptr) {
+        CloseHandle(m_file);
+    }
+}
+
+bool MappedFile::flush(size_t offset, size_t size) {
+    assert(offset + size <= m_size);
+
+    return FlushViewOfFile(static_cast<char*>(m_data) + offset, size) && FlushFileBuffers(m_file);
+}
+
+void MappedFile::evict(size_t offset, size_t size) {
+    assert(offset + size <= m_size);
+
+    // Unlocking pages that aren't locked removes them from the working set.
+    VirtualUnlock(static_cast<char*>(m_data) + offset, size);
+}
+
+#else
+
+std::unique_ptr<MappedFile> MappedFile::map(const std::string& path, size_t size, bool is_truncated) {
+    assert(size > 0);
+
+    std::unique_ptr<MappedFile> result(new MappedFile());
+
+    result->m_file = ::open(path.c_str(), O_RDWR | O_CREAT | (is_truncated ? O_TRUNC : 0), 0644);
+    if (result->m_file < 0) {
+        return nullptr;
+    }
+
+    if (ftruncate(result->m_file, static_cast<off_t>(size)) != 0) {
+        return nullptr;
+    }
+
+    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, result->m_file, 0);
+    if (data == MAP_FAILED) {
+        return nullptr;
+    }
+
+    result->m_data = data;
+    result->m_size = size;
+    return result;
+}
+
+MappedFile::~MappedFile() {
+    if (m_data != nullptr) {
+        munmap(m_data, m_size);
+    }
+    if (m_file >= 0) {
+        close(m_file);
+    }
+}
+
+bool MappedFile::flush(size_t offset, size_t size) {
+    assert(offset + size <= m_size);
+
+    // `msync` takes page aligned addresses.
+    auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t aligned_offset = offset / page_size * page_size;
+
+    return msync(static_cast<char*>(m_data) + aligned_offset, size + offset - aligned_offset, MS_SYNC) == 0;
+}
+
+void MappedFile::evict(size_t offset, size_t size) {
+    assert(offset + size <= m_size);
+
+    // Pages of a shared file mapping are only unmapped, dirty ones stay in the page cache until they're written back.
+    // Pages partially outside of the range are evicted as well, which is safe for the same reason.
+    auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t aligned_offset = offset / page_size * page_size;
+
+    madvise(static_cast<char*>(m_data) + aligned_offset, size + offset - aligned_offset, MADV_DONTNEED);
+}
+
+#endif
+
+void* MappedFile::data() const {
+    return m_data;
+}
+
+size_t MappedFile::size() const {
+    return m_size;
+}
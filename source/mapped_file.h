@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+// File mapped into memory for reading and writing. Changes reach the file through the page cache, `flush` waits until
+// they're on disk.
+class MappedFile {
+public:
+    // Creates the file if it doesn't exist and resizes it to `size` bytes. Returns nullptr on failure.
+    static std::unique_ptr<MappedFile> open(const std::string& path, size_t size);
+
+    // Same as `open`, but the contents of an existing file are discarded, so the file is zero filled.
+    static std::unique_ptr<MappedFile> create(const std::string& path, size_t size);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    void* data() const;
+    size_t size() const;
+
+    // Returns false if the range couldn't be written to disk.
+    bool flush(size_t offset, size_t size);
+
+    // Removes the pages of the range from the memory of the process without waiting for them to be written. Their
+    // contents are kept and are read back when the range is accessed again.
+    void evict(size_t offset, size_t size);
+
+private:
+    MappedFile() = default;
+
+    static std::unique_ptr<MappedFile> map(const std::string& path, size_t size, bool is_truncated);
+
+    void* m_data = nullptr;
+    size_t m_size = 0;
+
+#ifdef _WIN32
+    void* m_file = nullptr;
+    void* m_mapping = nullptr;
+#else
+    int m_file = -1;
+#endif
+};
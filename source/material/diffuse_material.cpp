@@ -37,3 +37,7 @@ float3 DiffuseMaterial::bsdf(const float3& ingoing, const float3& outgoing, doub
     pdf = 1 / (2 * PI);
     return m_albedo / PI;
 }
+
+float3 DiffuseMaterial::albedo() const {
+    return m_albedo;
+}
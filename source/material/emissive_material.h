@@ -2,7 +2,7 @@
 
 #include "material/material.h"
 
-class EmissiveMaterial : public Material {
+class EmissiveMaterial final : public Material {
 public:
     EmissiveMaterial(const float3& emissive);
 
@@ -76,6 +76,10 @@ float3 Material::emissive() const {
     return float3();
 }
 
+float3 Material::albedo() const {
+    return float3(1.0);
+}
+
 bool Material::is_specular() const {
     return false;
 }
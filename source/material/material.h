@@ -16,5 +16,8 @@ public:
 
     virtual float3 emissive() const;
 
+    // Fraction of the light that is reflected, as seen by a denoiser. White for materials that aren't diffuse.
+    virtual float3 albedo() const;
+
     virtual bool is_specular() const;
 };
@@ -0,0 +1,25 @@
+#include "material/material_variant.h"
+
+#include <cassert>
+
+MaterialVariant make_material_variant(const Material* material) {
+    assert(material != nullptr);
+
+    if (auto diffuse_material = dynamic_cast<const DiffuseMaterial*>(material)) {
+        return diffuse_material;
+    }
+
+    if (auto specular_reflective_material = dynamic_cast<const SpecularReflectiveMaterial*>(material)) {
+        return specular_reflective_material;
+    }
+
+    if (auto specular_transmissive_material = dynamic_cast<const SpecularTransmissiveMaterial*>(material)) {
+        return specular_transmissive_material;
+    }
+
+    if (auto emissive_material = dynamic_cast<const EmissiveMaterial*>(material)) {
+        return emissive_material;
+    }
+
+    return material;
+}
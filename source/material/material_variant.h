@@ -0,0 +1,20 @@
+#pragma once
+
+#include "material/diffuse_material.h"
+#include "material/emissive_material.h"
+#include "material/specular_reflective_material.h"
+#include "material/specular_transmissive_material.h"
+
+#include <variant>
+
+// Closed set of the built-in materials. Calls through a variant alternative are resolved at compile time because every
+// built-in material is final. Other materials fall back to the virtual interface through the last alternative.
+using MaterialVariant = std::variant<
+    const DiffuseMaterial*,
+    const SpecularReflectiveMaterial*,
+    const SpecularTransmissiveMaterial*,
+    const EmissiveMaterial*,
+    const Material*
+>;
+
+MaterialVariant make_material_variant(const Material* material);
@@ -2,10 +2,12 @@
 
 #include "material/material.h"
 
-class SpecularReflectiveMaterial : public Material {
+class SpecularReflectiveMaterial final : public Material {
 public:
     SpecularReflectiveMaterial(double ior);
 
+    using Material::bsdf;
+
     float3 bsdf(float3& ingoing, const float3& outgoing, double& pdf, const float2& random) const override;
 
     bool is_specular() const override;
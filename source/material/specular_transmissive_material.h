@@ -2,10 +2,12 @@
 
 #include "material/material.h"
 
-class SpecularTransmissiveMaterial : public Material {
+class SpecularTransmissiveMaterial final : public Material {
 public:
     SpecularTransmissiveMaterial(double ior);
 
+    using Material::bsdf;
+
     float3 bsdf(float3& ingoing, const float3& outgoing, double& pdf, const float2& random) const override;
 
     bool is_specular() const override;
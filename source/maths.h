@@ -451,7 +451,7 @@ public:
     }
 
     constexpr float2x2(const float2& _r0, const float2& _r1) 
-        : _r0(_r0), _r1(_r1)
+        : _11(_r0.x), _12(_r0.y), _21(_r1.x), _22(_r1.y)
     {
     }
 
@@ -599,11 +599,6 @@ public:
             double _21, _22;
         };
 
-        struct {
-            float2 _r0;
-            float2 _r1;
-        };
-
         float2 rows[2];
         double cells[4];
     };
@@ -662,7 +657,7 @@ public:
     }
 
     constexpr float3x3(const float3& _r0, const float3& _r1, const float3& _r2)
-        : _r0(_r0), _r1(_r1), _r2(_r2)
+        : _11(_r0.x), _12(_r0.y), _13(_r0.z), _21(_r1.x), _22(_r1.y), _23(_r1.z), _31(_r2.x), _32(_r2.y), _33(_r2.z)
     {
     }
 
@@ -853,12 +848,6 @@ public:
             double _31, _32, _33;
         };
 
-        struct {
-            float3 _r0;
-            float3 _r1;
-            float3 _r2;
-        };
-
         float3 rows[3];
         double cells[9];
     };
@@ -2,63 +2,50 @@
 
 #include <cassert>
 
-Primitive::Primitive(std::shared_ptr<Geometry> geometry, std::shared_ptr<Material> material, const float4x4& transform)
-    : m_geometry(std::move(geometry))
-    , m_material(std::move(material))
-    , m_transform(transform)
-    , m_inv_transform(inverse(transform))
-{
-    assert(m_geometry != nullptr);
-    assert(m_material != nullptr);
-}
-
-std::optional<GeometryHit> Primitive::geometry_raycast(const float3& origin, const float3& direction, double length) const {
+std::optional<GeometryHit> object_raycast(const GeometryVariant& geometry, const float4x4& inverse_transform, const float3& origin, const float3& direction, double length) {
     assert(isfinite(origin));
     assert(equal(::length(direction), 1.0));
     assert(length >= 0.0);
 
-    float3 object_origin(point_transform(origin, m_inv_transform));
-    float3 object_direction(normalize(direction * m_inv_transform));
+    float3 object_origin(point_transform(origin, inverse_transform));
+    float3 object_direction(normalize(direction * inverse_transform));
 
     assert(isfinite(object_origin));
     assert(equal(::length(object_direction), 1.0));
 
-    std::optional<GeometryHit> object_result = m_geometry->raycast(object_origin, object_direction, length);
-    if (object_result) {
-        assert(isfinite(object_result->position));
-        assert(equal(::length(object_result->tangent), 1.0));
-        assert(equal(::length(object_result->bitangent), 1.0));
-        assert(equal(::length(object_result->normal), 1.0));
-        assert(object_result->distance >= 0 && object_result->distance <= length);
-
-        float3 world_position = point_transform(object_result->position, m_transform);
-        float3 world_tangent = normalize(object_result->tangent * m_transform);
-        float3 world_bitangent = normalize(object_result->bitangent * m_transform);
-        float3 world_normal = normalize(normal_transform(object_result->normal, m_inv_transform));
-
-        assert(isfinite(world_position));
-        assert(equal(::length(world_tangent), 1.0));
-        assert(equal(::length(world_bitangent), 1.0));
-        assert(equal(::length(world_normal), 1.0));
-        assert(object_result->distance > 0.0 && object_result->distance <= length);
-
-        GeometryHit world_result;
-        world_result.position = world_position;
-        world_result.tangent = world_tangent;
-        world_result.bitangent = world_bitangent;
-        world_result.normal = world_normal;
-        world_result.distance = object_result->distance;
-        return world_result;
+    std::optional<GeometryHit> result = std::visit([&](auto* geometry) { return geometry->raycast(object_origin, object_direction, length); }, geometry);
+    if (result) {
+        assert(isfinite(result->position));
+        assert(equal(::length(result->tangent), 1.0));
+        assert(equal(::length(result->bitangent), 1.0));
+        assert(equal(::length(result->normal), 1.0));
+        assert(result->distance > 0.0 && result->distance <= length);
     }
 
-    return std::nullopt;
+    return result;
 }
 
-GeometrySample Primitive::geometry_sample(const float2& random) const {
+GeometryHit world_hit(const GeometryHit& object_hit, const float4x4& transform, const float4x4& inverse_transform) {
+    GeometryHit result;
+    result.position = point_transform(object_hit.position, transform);
+    result.tangent = normalize(object_hit.tangent * transform);
+    result.bitangent = normalize(object_hit.bitangent * transform);
+    result.normal = normalize(normal_transform(object_hit.normal, inverse_transform));
+    result.distance = object_hit.distance;
+
+    assert(isfinite(result.position));
+    assert(equal(length(result.tangent), 1.0));
+    assert(equal(length(result.bitangent), 1.0));
+    assert(equal(length(result.normal), 1.0));
+
+    return result;
+}
+
+GeometrySample world_sample(const GeometryVariant& geometry, const float4x4& transform, const float4x4& inverse_transform, const float2& random) {
     assert(random[0] >= 0.0 && random[0] < 1.0);
     assert(random[1] >= 0.0 && random[1] < 1.0);
 
-    GeometrySample object_space_sample = m_geometry->sample(random);
+    GeometrySample object_space_sample = std::visit([&](auto* geometry) { return geometry->sample(random); }, geometry);
 
     assert(isfinite(object_space_sample.position));
     assert(equal(length(object_space_sample.tangent), 1.0));
@@ -66,10 +53,10 @@ GeometrySample Primitive::geometry_sample(const float2& random) const {
     assert(equal(length(object_space_sample.normal), 1.0));
 
     GeometrySample world_space_sample;
-    world_space_sample.position = point_transform(object_space_sample.position, m_transform);
-    world_space_sample.tangent = normalize(object_space_sample.tangent * m_transform);
-    world_space_sample.bitangent = normalize(object_space_sample.bitangent * m_transform);
-    world_space_sample.normal = normalize(normal_transform(object_space_sample.normal, m_inv_transform));
+    world_space_sample.position = point_transform(object_space_sample.position, transform);
+    world_space_sample.tangent = normalize(object_space_sample.tangent * transform);
+    world_space_sample.bitangent = normalize(object_space_sample.bitangent * transform);
+    world_space_sample.normal = normalize(normal_transform(object_space_sample.normal, inverse_transform));
 
     assert(isfinite(world_space_sample.position));
     assert(equal(length(world_space_sample.tangent), 1.0));
@@ -79,17 +66,17 @@ GeometrySample Primitive::geometry_sample(const float2& random) const {
     return world_space_sample;
 }
 
-double Primitive::geometry_pdf(const float3& origin, const float3& direction) const {
+double world_pdf(const GeometryVariant& geometry, const float4x4& inverse_transform, const float3& origin, const float3& direction) {
     assert(isfinite(origin));
     assert(equal(::length(direction), 1.0));
 
-    float3 object_origin(point_transform(origin, m_inv_transform));
-    float3 object_direction(normalize(direction * m_inv_transform));
+    float3 object_origin(point_transform(origin, inverse_transform));
+    float3 object_direction(normalize(direction * inverse_transform));
 
     assert(isfinite(object_origin));
     assert(equal(::length(object_direction), 1.0));
 
-    double result = m_geometry->pdf(object_origin, object_direction);
+    double result = std::visit([&](auto* geometry) { return geometry->pdf(object_origin, object_direction); }, geometry);
 
     assert(std::isfinite(result));
     assert(result >= 0.0);
@@ -97,12 +84,40 @@ double Primitive::geometry_pdf(const float3& origin, const float3& direction) co
     return result;
 }
 
+Primitive::Primitive(std::shared_ptr<Geometry> geometry, std::shared_ptr<Material> material, const float4x4& transform)
+    : m_geometry(std::move(geometry))
+    , m_material(std::move(material))
+    , m_geometry_variant(make_geometry_variant(m_geometry.get()))
+    , m_material_variant(make_material_variant(m_material.get()))
+    , m_transform(transform)
+    , m_inv_transform(inverse(transform))
+{
+    assert(m_geometry != nullptr);
+    assert(m_material != nullptr);
+}
+
+std::optional<GeometryHit> Primitive::geometry_raycast(const float3& origin, const float3& direction, double length) const {
+    std::optional<GeometryHit> object_result = object_raycast(m_geometry_variant, m_inv_transform, origin, direction, length);
+    if (object_result) {
+        return world_hit(*object_result, m_transform, m_inv_transform);
+    }
+    return std::nullopt;
+}
+
+GeometrySample Primitive::geometry_sample(const float2& random) const {
+    return world_sample(m_geometry_variant, m_transform, m_inv_transform, random);
+}
+
+double Primitive::geometry_pdf(const float3& origin, const float3& direction) const {
+    return world_pdf(m_geometry_variant, m_inv_transform, origin, direction);
+}
+
 float3 Primitive::material_bsdf(float3& ingoing, const float3& outgoing, double& pdf, const float2& random) const {
     assert(equal(length(outgoing), 1.0));
     assert(random[0] >= 0.0 && random[0] < 1.0);
     assert(random[1] >= 0.0 && random[1] < 1.0);
 
-    float3 result = m_material->bsdf(ingoing, outgoing, pdf, random);
+    float3 result = std::visit([&](auto* material) { return material->bsdf(ingoing, outgoing, pdf, random); }, m_material_variant);
 
     assert(result.x >= 0.0 && result.y >= 0.0 && result.z >= 0.0);
     assert(equal(length(ingoing), 1.0));
@@ -115,7 +130,7 @@ float3 Primitive::material_bsdf(const float3& ingoing, const float3& outgoing, d
     assert(equal(length(ingoing), 1.0));
     assert(equal(length(outgoing), 1.0));
 
-    float3 result = m_material->bsdf(ingoing, outgoing, pdf);
+    float3 result = std::visit([&](auto* material) { return material->bsdf(ingoing, outgoing, pdf); }, m_material_variant);
 
     assert(isfinite(result));
     assert(result.x >= 0.0 && result.y >= 0.0 && result.z >= 0.0);
@@ -125,7 +140,7 @@ float3 Primitive::material_bsdf(const float3& ingoing, const float3& outgoing, d
 }
 
 float3 Primitive::material_emissive() const {
-    float3 result = m_material->emissive();
+    float3 result = std::visit([](auto* material) { return material->emissive(); }, m_material_variant);
 
     assert(isfinite(result));
     assert(result.r >= 0.0 && result.g >= 0.0 && result.b >= 0.0);
@@ -134,5 +149,33 @@ float3 Primitive::material_emissive() const {
 }
 
 bool Primitive::is_material_specular() const {
-    return m_material->is_specular();
+    return std::visit([](auto* material) { return material->is_specular(); }, m_material_variant);
+}
+
+const GeometryVariant& Primitive::geometry() const {
+    return m_geometry_variant;
+}
+
+const MaterialVariant& Primitive::material() const {
+    return m_material_variant;
+}
+
+size_t Primitive::material_type() const {
+    return m_material_variant.index();
+}
+
+const std::shared_ptr<Geometry>& Primitive::shared_geometry() const {
+    return m_geometry;
+}
+
+const std::shared_ptr<Material>& Primitive::shared_material() const {
+    return m_material;
+}
+
+const float4x4& Primitive::transform() const {
+    return m_transform;
+}
+
+const float4x4& Primitive::inverse_transform() const {
+    return m_inv_transform;
 }
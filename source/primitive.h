@@ -1,10 +1,18 @@
 #pragma once
 
-#include "geometry/geometry.h"
-#include "material/material.h"
+#include "geometry/geometry_variant.h"
+#include "material/material_variant.h"
 
 #include <memory>
 
+// Geometry queries of a primitive placed by a transform, shared by `Primitive` and the flattened primitives of `Scene`.
+// Raycasts return the hit in object space, so that only the closest hit has to be moved to world space.
+std::optional<GeometryHit> object_raycast(const GeometryVariant& geometry, const float4x4& inverse_transform, const float3& origin, const float3& direction, double length);
+GeometryHit world_hit(const GeometryHit& object_hit, const float4x4& transform, const float4x4& inverse_transform);
+GeometrySample world_sample(const GeometryVariant& geometry, const float4x4& transform, const float4x4& inverse_transform, const float2& random);
+double world_pdf(const GeometryVariant& geometry, const float4x4& inverse_transform, const float3& origin, const float3& direction);
+
+// Description of a primitive that scenes are built from.
 class Primitive {
 public:
     Primitive(std::shared_ptr<Geometry> geometry, std::shared_ptr<Material> material, const float4x4& transform);
@@ -18,9 +26,22 @@ public:
     float3 material_emissive() const;
     bool is_material_specular() const;
 
+    const GeometryVariant& geometry() const;
+    const MaterialVariant& material() const;
+    size_t material_type() const;
+
+    // Owners of the geometry and material, for keeping them alive without the primitive.
+    const std::shared_ptr<Geometry>& shared_geometry() const;
+    const std::shared_ptr<Material>& shared_material() const;
+
+    const float4x4& transform() const;
+    const float4x4& inverse_transform() const;
+
 private:
     std::shared_ptr<Geometry> m_geometry;
     std::shared_ptr<Material> m_material;
+    GeometryVariant m_geometry_variant;
+    MaterialVariant m_material_variant;
     float4x4 m_transform;
     float4x4 m_inv_transform;
 };
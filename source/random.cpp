@@ -1,15 +1,49 @@
 #include "random.h"
 
-Random::Random(int seed)
-    : m_generator(seed)
-    , m_distribution(0.0, 1.0)
-{
+static constexpr uint64_t PCG_MULTIPLIER = 6364136223846793005ull;
+static constexpr uint64_t PCG_INCREMENT = 1442695040888963407ull;
+
+// MurmurHash3 finalizer.
+static uint64_t mix(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xFF51AFD7ED558CCDull;
+    value ^= value >> 33;
+    value *= 0xC4CEB9FE1A85EC53ull;
+    value ^= value >> 33;
+    return value;
+}
+
+Random::Random(uint64_t seed) {
+    this->seed(seed);
+}
+
+void Random::seed(uint64_t seed) {
+    m_state = seed + PCG_INCREMENT;
+    next();
 }
 
 double Random::rand() {
-    return m_distribution(m_generator);
+    // 32 bits of precision, the result is below one.
+    return next() * (1.0 / 4294967296.0);
 }
 
 float2 Random::rand2() {
     return float2(rand(), rand());
 }
+
+uint32_t Random::next() {
+    uint64_t state = m_state;
+    m_state = state * PCG_MULTIPLIER + PCG_INCREMENT;
+
+    // XSH RR output function.
+    auto xorshifted = static_cast<uint32_t>(((state >> 18) ^ state) >> 27);
+    auto rotation = static_cast<uint32_t>(state >> 59);
+    return (xorshifted >> rotation) | (xorshifted << ((32 - rotation) & 31));
+}
+
+uint64_t sample_seed(int x, int y, int sample, uint32_t seed) {
+    // The seed is spread over all bits by the golden ratio, coordinates and the sample index are hashed in turn.
+    uint64_t hash = mix(seed * 0x9E3779B97F4A7C15ull + static_cast<uint32_t>(x));
+    hash = mix(hash ^ ((static_cast<uint64_t>(static_cast<uint32_t>(y)) << 32) | static_cast<uint32_t>(sample)));
+    return hash;
+}
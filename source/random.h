@@ -2,16 +2,25 @@
 
 #include "maths.h"
 
-#include <random>
+#include <cstdint>
 
+// PCG32 generator. Its state is small and seeding it is cheap, so a generator can be seeded for every sample.
 class Random {
 public:
-    Random(int seed);
+    Random(uint64_t seed);
+
+    void seed(uint64_t seed);
 
     double rand();
     float2 rand2();
 
 private:
-    std::mt19937 m_generator;
-    std::uniform_real_distribution<double> m_distribution;
+    uint32_t next();
+
+    uint64_t m_state;
 };
+
+// Seed of the random numbers of a sample of a pixel. Samples are a function of their pixel, their index and the seed of
+// the render only, so renders don't depend on the number of threads and on which thread renders which sample. Renders
+// with different `seed` get independent samples.
+uint64_t sample_seed(int x, int y, int sample, uint32_t seed);
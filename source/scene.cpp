@@ -0,0 +1,204 @@
+#include "scene.h"
+#include "trace.h"
+
+#include <cassert>
+#include <limits>
+#include <new>
+
+Scene::Scene(std::vector<Primitive>&& primitives)
+    : m_primitive_count(primitives.size())
+    , m_light_count(0)
+{
+    TraceScope trace_scope("scene build");
+
+    assert(m_primitive_count < std::numeric_limits<uint32_t>::max());
+
+    // The transforms come first, so every array is aligned for its type.
+    size_t transforms_size = m_primitive_count * sizeof(float4x4);
+    size_t indices_size = m_primitive_count * sizeof(uint32_t);
+    m_arena = std::make_unique<std::byte[]>(transforms_size * 2 + indices_size * 3);
+
+    m_transforms = reinterpret_cast<float4x4*>(m_arena.get());
+    m_inverse_transforms = reinterpret_cast<float4x4*>(m_arena.get() + transforms_size);
+    m_geometry_indices = reinterpret_cast<uint32_t*>(m_arena.get() + transforms_size * 2);
+    m_material_indices = reinterpret_cast<uint32_t*>(m_arena.get() + transforms_size * 2 + indices_size);
+    m_lights = reinterpret_cast<uint32_t*>(m_arena.get() + transforms_size * 2 + indices_size * 2);
+
+    std::vector<Primitive> source(std::move(primitives));
+    for (size_t i = 0; i < m_primitive_count; i++) {
+        new (&m_transforms[i]) float4x4(source[i].transform());
+        new (&m_inverse_transforms[i]) float4x4(source[i].inverse_transform());
+        m_geometry_indices[i] = add_geometry(source[i].shared_geometry());
+        m_material_indices[i] = add_material(source[i].shared_material());
+    }
+
+    collect_lights();
+}
+
+std::optional<SceneHit> Scene::raycast(const float3& origin, const float3& direction, uint64_t* primitive_tests) const {
+    std::optional<GeometryHit> object_hit;
+    size_t hit_index = 0;
+    double length = std::numeric_limits<double>::infinity();
+
+    for (size_t i = 0; i < m_primitive_count; i++) {
+        std::optional<GeometryHit> hit = object_raycast(m_geometry_variants[m_geometry_indices[i]], m_inverse_transforms[i], origin, direction, length);
+        if (hit) {
+            object_hit = hit;
+            hit_index = i;
+            length = hit->distance;
+        }
+    }
+
+    if (primitive_tests != nullptr) {
+        *primitive_tests += m_primitive_count;
+    }
+
+    if (!object_hit) {
+        return std::nullopt;
+    }
+
+    SceneHit result;
+    static_cast<GeometryHit&>(result) = world_hit(*object_hit, m_transforms[hit_index], m_inverse_transforms[hit_index]);
+    result.primitive = static_cast<uint32_t>(hit_index);
+    result.material = m_material_variants[m_material_indices[hit_index]];
+    return result;
+}
+
+GeometrySample Scene::sample_light(double random, const float2& random_position) const {
+    assert(m_light_count > 0);
+    assert(random >= 0.0 && random < 1.0);
+
+    uint32_t light = m_lights[static_cast<size_t>(random * m_light_count)];
+    return world_sample(m_geometry_variants[m_geometry_indices[light]], m_transforms[light], m_inverse_transforms[light], random_position);
+}
+
+double Scene::light_pdf(const float3& origin, const float3& direction) const {
+    assert(m_light_count > 0);
+
+    double result = 0.0;
+    for (size_t i = 0; i < m_light_count; i++) {
+        uint32_t light = m_lights[i];
+        result += world_pdf(m_geometry_variants[m_geometry_indices[light]], m_inverse_transforms[light], origin, direction);
+    }
+    return result / m_light_count;
+}
+
+bool Scene::has_lights() const {
+    return m_light_count > 0;
+}
+
+size_t Scene::primitive_count() const {
+    return m_primitive_count;
+}
+
+void Scene::replace_primitive(size_t index, const Primitive& primitive) {
+    assert(index < m_primitive_count);
+
+    bool was_light = is_light(index);
+
+    m_transforms[index] = primitive.transform();
+    m_inverse_transforms[index] = primitive.inverse_transform();
+
+    // Added before the old ones are released, so an entry the primitive keeps is never freed.
+    uint32_t geometry = add_geometry(primitive.shared_geometry());
+    uint32_t material = add_material(primitive.shared_material());
+    release_geometry(m_geometry_indices[index]);
+    release_material(m_material_indices[index]);
+    m_geometry_indices[index] = geometry;
+    m_material_indices[index] = material;
+
+    if (was_light || is_light(index)) {
+        collect_lights();
+    }
+}
+
+uint32_t Scene::add_geometry(const std::shared_ptr<Geometry>& geometry) {
+    assert(geometry != nullptr);
+
+    auto it = m_geometry_table.find(geometry.get());
+    if (it != m_geometry_table.end()) {
+        m_geometry_uses[it->second]++;
+        return it->second;
+    }
+
+    uint32_t result;
+    if (!m_free_geometries.empty()) {
+        result = m_free_geometries.back();
+        m_free_geometries.pop_back();
+        m_geometries[result] = geometry;
+        m_geometry_variants[result] = make_geometry_variant(geometry.get());
+        m_geometry_uses[result] = 1;
+    } else {
+        result = static_cast<uint32_t>(m_geometries.size());
+        m_geometries.push_back(geometry);
+        m_geometry_variants.push_back(make_geometry_variant(geometry.get()));
+        m_geometry_uses.push_back(1);
+    }
+
+    m_geometry_table.emplace(geometry.get(), result);
+    return result;
+}
+
+uint32_t Scene::add_material(const std::shared_ptr<Material>& material) {
+    assert(material != nullptr);
+
+    auto it = m_material_table.find(material.get());
+    if (it != m_material_table.end()) {
+        m_material_uses[it->second]++;
+        return it->second;
+    }
+
+    uint32_t result;
+    if (!m_free_materials.empty()) {
+        result = m_free_materials.back();
+        m_free_materials.pop_back();
+        m_materials[result] = material;
+        m_material_variants[result] = make_material_variant(material.get());
+        m_material_uses[result] = 1;
+    } else {
+        result = static_cast<uint32_t>(m_materials.size());
+        m_materials.push_back(material);
+        m_material_variants.push_back(make_material_variant(material.get()));
+        m_material_uses.push_back(1);
+    }
+
+    m_material_table.emplace(material.get(), result);
+    return result;
+}
+
+void Scene::release_geometry(uint32_t index) {
+    assert(index < m_geometries.size());
+    assert(m_geometry_uses[index] > 0);
+
+    if (--m_geometry_uses[index] == 0) {
+        m_geometry_table.erase(m_geometries[index].get());
+        m_geometries[index] = nullptr;
+        m_free_geometries.push_back(index);
+    }
+}
+
+void Scene::release_material(uint32_t index) {
+    assert(index < m_materials.size());
+    assert(m_material_uses[index] > 0);
+
+    if (--m_material_uses[index] == 0) {
+        m_material_table.erase(m_materials[index].get());
+        m_materials[index] = nullptr;
+        m_free_materials.push_back(index);
+    }
+}
+
+bool Scene::is_light(size_t index) const {
+    float3 emissive = std::visit([](auto* material) { return material->emissive(); }, m_material_variants[m_material_indices[index]]);
+    return !equal(emissive, 0.0);
+}
+
+void Scene::collect_lights() {
+    m_light_count = 0;
+
+    for (size_t i = 0; i < m_primitive_count; i++) {
+        if (is_light(i)) {
+            m_lights[m_light_count++] = static_cast<uint32_t>(i);
+        }
+    }
+}
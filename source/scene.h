@@ -0,0 +1,78 @@
+#pragma once
+
+#include "primitive.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+struct SceneHit : GeometryHit {
+    // Index of the primitive in the scene.
+    uint32_t primitive;
+    MaterialVariant material;
+};
+
+// Primitives flattened into index based arrays that share a single allocation: the transforms, the geometry and
+// material of every primitive as indices into the tables of the distinct ones, and the indices of the lights. A raycast
+// scans the inverse transforms and geometry indices, the transforms are only read for the closest hit.
+class Scene {
+public:
+    // The primitives are only read while the scene is built, they are freed once it is.
+    Scene(std::vector<Primitive>&& primitives);
+
+    // Adds the number of ray-primitive tests to `primitive_tests` if it's not null.
+    std::optional<SceneHit> raycast(const float3& origin, const float3& direction, uint64_t* primitive_tests = nullptr) const;
+
+    // Samples a point on a light, the light is picked uniformly by `random`.
+    GeometrySample sample_light(double random, const float2& random_position) const;
+    double light_pdf(const float3& origin, const float3& direction) const;
+
+    bool has_lights() const;
+
+    size_t primitive_count() const;
+
+    // Replaces a primitive in place, its geometry and material objects are shared rather than copied. The lights are
+    // only collected again if the primitive was or becomes emissive. Geometries and materials no primitive uses anymore
+    // are released.
+    void replace_primitive(size_t index, const Primitive& primitive);
+
+private:
+    // Return the index of the geometry or material in its table, adding it if it's not there yet, and count a use.
+    uint32_t add_geometry(const std::shared_ptr<Geometry>& geometry);
+    uint32_t add_material(const std::shared_ptr<Material>& material);
+
+    // Count a use less, the entry is freed for a later one once unused.
+    void release_geometry(uint32_t index);
+    void release_material(uint32_t index);
+
+    bool is_light(size_t index) const;
+    void collect_lights();
+
+    size_t m_primitive_count;
+    size_t m_light_count;
+
+    // Every array below points into the arena.
+    std::unique_ptr<std::byte[]> m_arena;
+    float4x4* m_transforms;
+    float4x4* m_inverse_transforms;
+    uint32_t* m_geometry_indices;
+    uint32_t* m_material_indices;
+    uint32_t* m_lights;
+
+    // Indices of unused entries are kept in the free lists, their objects are released and their variants dangle until
+    // the entries are used again.
+    std::vector<std::shared_ptr<Geometry>> m_geometries;
+    std::vector<GeometryVariant> m_geometry_variants;
+    std::vector<uint32_t> m_geometry_uses;
+    std::vector<uint32_t> m_free_geometries;
+    std::unordered_map<const Geometry*, uint32_t> m_geometry_table;
+
+    std::vector<std::shared_ptr<Material>> m_materials;
+    std::vector<MaterialVariant> m_material_variants;
+    std::vector<uint32_t> m_material_uses;
+    std::vector<uint32_t> m_free_materials;
+    std::unordered_map<const Material*, uint32_t> m_material_table;
+};
@@ -0,0 +1,96 @@
+#include "geometry/box_geometry.h"
+#include "geometry/sphere_geometry.h"
+#include "material/diffuse_material.h"
+#include "material/emissive_material.h"
+#include "material/specular_reflective_material.h"
+#include "material/specular_transmissive_material.h"
+#include "scenes/cornell_box.h"
+#include "trace.h"
+
+#include <cassert>
+
+std::vector<Primitive> build_cornell_box(CornellBoxVariant variant) {
+    TraceScope trace_scope("build_cornell_box");
+
+    auto long_wall_geometry = std::make_shared<BoxGeometry>(float3(0.5, 0.5, 1.5));
+    assert(long_wall_geometry != nullptr);
+    
+    auto short_wall_geometry = std::make_shared<BoxGeometry>(float3(0.5));
+    assert(short_wall_geometry != nullptr);
+
+    auto top_side_geometry = std::make_shared<BoxGeometry>(float3(0.2, 0.5, 1.5));
+    assert(top_side_geometry != nullptr);
+
+    auto top_front_geometry = std::make_shared<BoxGeometry>(float3(0.1, 0.5, 0.2));
+    assert(top_front_geometry != nullptr);
+
+    auto top_back_geometry = std::make_shared<BoxGeometry>(float3(0.1, 0.5, 1.2));
+    assert(top_back_geometry != nullptr);
+    
+    auto lamp_geometry = std::make_shared<BoxGeometry>(float3(0.1));
+    assert(lamp_geometry != nullptr);
+
+    auto left_box_geometry = std::make_shared<BoxGeometry>(float3(0.15, 0.275, 0.15));
+    assert(left_box_geometry != nullptr);
+
+    auto right_box_geometry = std::make_shared<BoxGeometry>(float3(0.15));
+    assert(right_box_geometry != nullptr);
+
+    auto sphere_geometry = std::make_shared<SphereGeometry>(0.15);
+    assert(sphere_geometry != nullptr);
+
+    auto red_material = std::make_shared<DiffuseMaterial>(float3(1.0, 0.0, 0.0));
+    assert(red_material != nullptr);
+    
+    auto green_material = std::make_shared<DiffuseMaterial>(float3(0.0, 1.0, 0.0));
+    assert(green_material != nullptr);
+    
+    auto white_material = std::make_shared<DiffuseMaterial>(float3(1.0));
+    assert(white_material != nullptr);
+
+    auto emissive_material = std::make_shared<EmissiveMaterial>(float3(15.0));
+    assert(emissive_material != nullptr);
+
+    auto reflective_material = std::make_shared<SpecularReflectiveMaterial>(10.0);
+    assert(reflective_material != nullptr);
+
+    auto transmissive_material = std::make_shared<SpecularTransmissiveMaterial>(2.5);
+    assert(transmissive_material != nullptr);
+
+    float4x4 left_box_transform = float4x4::rotation(float3(0.0, 1.0, 0.0), radians(-20.0)) * float4x4::translation(float3(-0.175, -0.225, 2.5));
+    float4x4 right_box_transform = float4x4::rotation(float3(0.0, 1.0, 0.0), radians(20.0)) * float4x4::translation(float3(0.175, -0.35, 2.3));
+
+    std::vector<Primitive> result {
+        { long_wall_geometry,  red_material,   float4x4::translation(float3(-1.0, 0.0, 1.4))  }, // left wall
+        { long_wall_geometry,  green_material, float4x4::translation(float3(1.0, 0.0, 1.4))   }, // right wall
+        { long_wall_geometry,  white_material, float4x4::translation(float3(0.0, -1.0, 1.4))  }, // bottom wall
+        { short_wall_geometry, white_material, float4x4::translation(float3(0.0, 0.0, 3.4))   }, // front wall
+        { short_wall_geometry, white_material, float4x4::translation(float3(0.0, 0.0, -0.6))  }, // back wall
+        { top_side_geometry,   white_material, float4x4::translation(float3(-0.3, 1.0, 1.4))  }, // top left wall
+        { top_side_geometry,   white_material, float4x4::translation(float3(0.3, 1.0, 1.4))   }, // top right wall
+        { top_front_geometry,  white_material, float4x4::translation(float3(0.0, 1.0, 2.7))   }, // top front wall
+        { top_back_geometry,   white_material, float4x4::translation(float3(0.0, 1.0, 1.1))   }, // top back wall
+    };
+
+    switch (variant) {
+        case CornellBoxVariant::BOXES:
+            result.push_back({ left_box_geometry,  white_material, left_box_transform  }); // left box
+            result.push_back({ right_box_geometry, white_material, right_box_transform }); // right box
+            break;
+        case CornellBoxVariant::REFLECTIVE_SPHERES:
+            result.push_back({ sphere_geometry, reflective_material, float4x4::translation(float3(-0.175, -0.35, 2.5)) }); // left sphere
+            result.push_back({ sphere_geometry, reflective_material, float4x4::translation(float3(0.175, -0.35, 2.3))  }); // right sphere
+            break;
+        case CornellBoxVariant::TRANSMISSIVE_SPHERES:
+            result.push_back({ sphere_geometry, transmissive_material, float4x4::translation(float3(-0.175, -0.35, 2.5)) }); // left sphere
+            result.push_back({ sphere_geometry, transmissive_material, float4x4::translation(float3(0.175, -0.35, 2.3))  }); // right sphere
+            break;
+        default:
+            assert(false);
+            break;
+    }
+
+    result.push_back({ lamp_geometry, emissive_material, float4x4::translation(float3(0.0, 0.61, 2.4)) }); // lamp
+
+    return result;
+}
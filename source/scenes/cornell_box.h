@@ -0,0 +1,14 @@
+#pragma once
+
+#include "primitive.h"
+
+#include <vector>
+
+enum class CornellBoxVariant {
+    BOXES,
+    REFLECTIVE_SPHERES,
+    TRANSMISSIVE_SPHERES,
+};
+
+// The room is seen from the camera at the origin looking along +Z.
+std::vector<Primitive> build_cornell_box(CornellBoxVariant variant = CornellBoxVariant::BOXES);
@@ -0,0 +1,162 @@
+#include "geometry/box_geometry.h"
+#include "geometry/sphere_geometry.h"
+#include "material/diffuse_material.h"
+#include "material/emissive_material.h"
+#include "material/specular_reflective_material.h"
+#include "material/specular_transmissive_material.h"
+#include "random.h"
+#include "scenes/procedural_scene.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <memory>
+
+// The cube of primitives.
+static constexpr double VOLUME_CENTER_Z = 3.2;
+static constexpr double VOLUME_HALF_SIZE = 0.8;
+
+// Number of distinct sizes of boxes and spheres, and of diffuse colors.
+static constexpr int GEOMETRY_VARIANTS = 16;
+static constexpr int DIFFUSE_VARIANTS = 8;
+
+// Shares of the materials, the rest of the primitives are diffuse.
+static constexpr double REFLECTIVE_SHARE = 0.08;
+static constexpr double TRANSMISSIVE_SHARE = 0.08;
+static constexpr double EMISSIVE_SHARE = 0.02;
+static constexpr double MANY_LIGHTS_EMISSIVE_SHARE = 0.5;
+
+static constexpr double SPHERE_SHARE = 0.5;
+
+// Standard deviation of the positions around the center of their cluster, relative to the size of the volume.
+static constexpr double CLUSTER_SPREAD = 0.03;
+static constexpr int PRIMITIVES_PER_CLUSTER = 1000;
+
+// Size of the primitives relative to the mean distance between their centers.
+static double relative_size(ProceduralLayout layout) {
+    switch (layout) {
+        case ProceduralLayout::UNIFORM:
+        case ProceduralLayout::MANY_LIGHTS:
+            return 0.3;
+        case ProceduralLayout::CLUSTERED:
+            return 0.1;
+        case ProceduralLayout::OVERLAPPING:
+            return 2.0;
+        default:
+            assert(false);
+            return 0.0;
+    }
+}
+
+// Normally distributed by the Box-Muller transform.
+static float3 random_normal(Random& random) {
+    float2 u = random.rand2();
+    float2 v = random.rand2();
+
+    double radius_u = std::sqrt(-2.0 * std::log(1.0 - u.x));
+    double radius_v = std::sqrt(-2.0 * std::log(1.0 - v.x));
+    return float3(radius_u * std::cos(2.0 * PI * u.y), radius_u * std::sin(2.0 * PI * u.y), radius_v * std::cos(2.0 * PI * v.y));
+}
+
+static float3 random_position(Random& random) {
+    return (float3(random.rand(), random.rand(), random.rand()) * 2.0 - float3(1.0)) * VOLUME_HALF_SIZE + float3(0.0, 0.0, VOLUME_CENTER_Z);
+}
+
+std::vector<Primitive> build_procedural_scene(const ProceduralSceneOptions& options) {
+    TraceScope trace_scope("build_procedural_scene");
+
+    assert(options.primitive_count > 0);
+
+    Random random(options.seed);
+
+    // Mean distance between the centers of the primitives if they filled the volume evenly.
+    double spacing = VOLUME_HALF_SIZE * 2.0 / std::cbrt(static_cast<double>(options.primitive_count));
+    double size = spacing * relative_size(options.layout);
+
+    std::vector<std::shared_ptr<Geometry>> box_geometries;
+    std::vector<std::shared_ptr<Geometry>> sphere_geometries;
+
+    for (int i = 0; i < GEOMETRY_VARIANTS; i++) {
+        auto box_geometry = std::make_shared<BoxGeometry>(float3(random.rand(), random.rand(), random.rand()) * size + float3(size * 0.5));
+        assert(box_geometry != nullptr);
+        box_geometries.push_back(std::move(box_geometry));
+
+        auto sphere_geometry = std::make_shared<SphereGeometry>(size * (0.5 + random.rand()));
+        assert(sphere_geometry != nullptr);
+        sphere_geometries.push_back(std::move(sphere_geometry));
+    }
+
+    std::vector<std::shared_ptr<Material>> diffuse_materials;
+    for (int i = 0; i < DIFFUSE_VARIANTS; i++) {
+        auto diffuse_material = std::make_shared<DiffuseMaterial>(float3(random.rand(), random.rand(), random.rand()) * 0.7 + float3(0.2));
+        assert(diffuse_material != nullptr);
+        diffuse_materials.push_back(std::move(diffuse_material));
+    }
+
+    auto reflective_material = std::make_shared<SpecularReflectiveMaterial>(10.0);
+    assert(reflective_material != nullptr);
+
+    auto transmissive_material = std::make_shared<SpecularTransmissiveMaterial>(1.5);
+    assert(transmissive_material != nullptr);
+
+    auto emissive_material = std::make_shared<EmissiveMaterial>(float3(5.0));
+    assert(emissive_material != nullptr);
+
+    auto lamp_geometry = std::make_shared<BoxGeometry>(float3(VOLUME_HALF_SIZE, 0.02, VOLUME_HALF_SIZE));
+    assert(lamp_geometry != nullptr);
+
+    auto lamp_material = std::make_shared<EmissiveMaterial>(float3(10.0));
+    assert(lamp_material != nullptr);
+
+    std::vector<float3> cluster_centers;
+    if (options.layout == ProceduralLayout::CLUSTERED) {
+        int cluster_count = std::max(options.primitive_count / PRIMITIVES_PER_CLUSTER, 1);
+        for (int i = 0; i < cluster_count; i++) {
+            cluster_centers.push_back(random_position(random));
+        }
+    }
+
+    double emissive_share = options.layout == ProceduralLayout::MANY_LIGHTS ? MANY_LIGHTS_EMISSIVE_SHARE : EMISSIVE_SHARE;
+
+    std::vector<Primitive> result;
+    result.reserve(static_cast<size_t>(options.primitive_count) + 1);
+
+    // The lamp keeps the scene lit when there are too few primitives for emissive ones.
+    result.push_back({ lamp_geometry, lamp_material, float4x4::translation(float3(0.0, VOLUME_HALF_SIZE + 0.4, VOLUME_CENTER_Z)) });
+
+    for (int i = 0; i < options.primitive_count; i++) {
+        float3 position;
+        if (cluster_centers.empty()) {
+            position = random_position(random);
+        } else {
+            const float3& cluster_center = cluster_centers[std::min(static_cast<size_t>(random.rand() * cluster_centers.size()), cluster_centers.size() - 1)];
+            position = cluster_center + random_normal(random) * (VOLUME_HALF_SIZE * 2.0 * CLUSTER_SPREAD);
+        }
+
+        int geometry_index = std::min(static_cast<int>(random.rand() * GEOMETRY_VARIANTS), GEOMETRY_VARIANTS - 1);
+        bool is_sphere = random.rand() < SPHERE_SHARE;
+
+        std::shared_ptr<Material> material;
+
+        double material_random = random.rand();
+        if (material_random < emissive_share) {
+            material = emissive_material;
+        } else if (material_random < emissive_share + REFLECTIVE_SHARE) {
+            material = reflective_material;
+        } else if (material_random < emissive_share + REFLECTIVE_SHARE + TRANSMISSIVE_SHARE) {
+            material = transmissive_material;
+        } else {
+            material = diffuse_materials[std::min(static_cast<int>(random.rand() * DIFFUSE_VARIANTS), DIFFUSE_VARIANTS - 1)];
+        }
+
+        if (is_sphere) {
+            result.push_back({ sphere_geometries[geometry_index], std::move(material), float4x4::translation(position) });
+        } else {
+            float4x4 transform = float4x4::rotation(float3(0.0, 1.0, 0.0), random.rand() * PI) * float4x4::translation(position);
+            result.push_back({ box_geometries[geometry_index], std::move(material), transform });
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "primitive.h"
+
+#include <cstdint>
+#include <vector>
+
+enum class ProceduralLayout {
+    // Primitives spread evenly through the volume, a few of them touching.
+    UNIFORM,
+
+    // Small primitives packed into tight clusters with empty space between them.
+    CLUSTERED,
+
+    // Primitives several times larger than the space between them, so that every ray overlaps many of them.
+    OVERLAPPING,
+
+    // Like `UNIFORM`, but half of the primitives are lights.
+    MANY_LIGHTS,
+};
+
+struct ProceduralSceneOptions {
+    int primitive_count = 1000;
+    ProceduralLayout layout = ProceduralLayout::UNIFORM;
+    uint32_t seed = 0;
+};
+
+// Boxes and spheres with diffuse, specular and emissive materials in a cube in front of the camera at the origin
+// looking along +Z, lit by a lamp above it. Primitives share a small set of geometries and materials, so memory use is
+// dominated by the primitives themselves. The same options always build the same scene.
+std::vector<Primitive> build_procedural_scene(const ProceduralSceneOptions& options);
@@ -0,0 +1,410 @@
+#include "geometry/box_geometry.h"
+#include "geometry/sphere_geometry.h"
+#include "material/diffuse_material.h"
+#include "material/emissive_material.h"
+#include "material/specular_reflective_material.h"
+#include "material/specular_transmissive_material.h"
+#include "scenes/scene_file.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cassert>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+
+// Splits the file into lines and the lines into whitespace separated tokens, without copying them.
+class Tokenizer {
+public:
+    Tokenizer(const char* begin, const char* end)
+        : m_cursor(begin)
+        , m_end(end)
+        , m_line(0)
+    {
+    }
+
+    // Moves to the next line with a statement. Returns false at the end of the file.
+    bool next_line() {
+        while (true) {
+            if (m_line > 0) {
+                while (m_cursor != m_end && *m_cursor != '\n') {
+                    m_cursor++;
+                }
+                if (m_cursor == m_end) {
+                    return false;
+                }
+                m_cursor++;
+            }
+            m_line++;
+
+            if (!is_line_end()) {
+                return true;
+            }
+            if (m_cursor == m_end) {
+                return false;
+            }
+        }
+    }
+
+    // Returns false at the end of the line.
+    bool token(std::string_view& result) {
+        if (is_line_end()) {
+            return false;
+        }
+
+        const char* begin = m_cursor;
+        while (m_cursor != m_end && !is_space(*m_cursor) && *m_cursor != '\n' && *m_cursor != '#') {
+            m_cursor++;
+        }
+
+        result = std::string_view(begin, m_cursor - begin);
+        return true;
+    }
+
+    bool number(double& result) {
+        std::string_view value;
+        if (!token(value)) {
+            return false;
+        }
+
+        auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), result);
+        return error == std::errc() && end == value.data() + value.size() && std::isfinite(result);
+    }
+
+    bool number(float3& result) {
+        return number(result.x) && number(result.y) && number(result.z);
+    }
+
+    bool integer(int& result) {
+        std::string_view value;
+        if (!token(value)) {
+            return false;
+        }
+
+        auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), result);
+        return error == std::errc() && end == value.data() + value.size();
+    }
+
+    // Skips whitespace, a comment ends the line as well.
+    bool is_line_end() {
+        while (m_cursor != m_end && is_space(*m_cursor)) {
+            m_cursor++;
+        }
+        return m_cursor == m_end || *m_cursor == '\n' || *m_cursor == '#';
+    }
+
+    int line() const {
+        return m_line;
+    }
+
+private:
+    static bool is_space(char c) {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    const char* m_cursor;
+    const char* m_end;
+    int m_line;
+};
+
+// Identical definitions share one object, keyed by their type and the bits of their parameters.
+template <typename T>
+class Definitions {
+public:
+    // Returns false if the name is taken.
+    bool add(std::string_view name, char type, const double* values, int value_count, const std::function<std::shared_ptr<T>()>& create) {
+        std::string key(1, type);
+        key.append(reinterpret_cast<const char*>(values), value_count * sizeof(double));
+
+        auto [it, is_inserted] = m_indices.emplace(key, static_cast<int>(m_keys.size()));
+        if (is_inserted) {
+            m_keys.push_back(std::move(key));
+            m_objects.push_back(create());
+            assert(m_objects.back() != nullptr);
+        }
+
+        return m_names.emplace(std::string(name), it->second).second;
+    }
+
+    // Returns -1 if there's no definition with the name.
+    int find(std::string_view name) const {
+        auto it = m_names.find(std::string(name));
+        return it != m_names.end() ? it->second : -1;
+    }
+
+    const std::shared_ptr<T>& object(int index) const {
+        assert(index >= 0 && index < static_cast<int>(m_objects.size()));
+        return m_objects[index];
+    }
+
+    std::vector<std::string>& keys() {
+        return m_keys;
+    }
+
+private:
+    std::unordered_map<std::string, int> m_indices;
+    std::unordered_map<std::string, int> m_names;
+    std::vector<std::string> m_keys;
+    std::vector<std::shared_ptr<T>> m_objects;
+};
+
+static bool parse_camera(Tokenizer& tokenizer, SceneFileSettings& settings) {
+    std::string_view keyword;
+    while (tokenizer.token(keyword)) {
+        double angle;
+
+        if (keyword == "position") {
+            if (!tokenizer.number(settings.camera_position)) {
+                return false;
+            }
+        } else if (keyword == "yaw") {
+            if (!tokenizer.number(angle)) {
+                return false;
+            }
+            settings.camera_yaw = radians(angle);
+        } else if (keyword == "pitch") {
+            if (!tokenizer.number(angle)) {
+                return false;
+            }
+            settings.camera_pitch = radians(angle);
+        } else if (keyword == "fov") {
+            if (!tokenizer.number(angle) || angle <= 0.0 || angle >= 180.0) {
+                return false;
+            }
+            settings.camera_fov = radians(angle);
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool parse_settings(Tokenizer& tokenizer, SceneFileSettings& settings) {
+    std::string_view keyword;
+    while (tokenizer.token(keyword)) {
+        int* value;
+
+        if (keyword == "width") {
+            value = &settings.width;
+        } else if (keyword == "height") {
+            value = &settings.height;
+        } else if (keyword == "spp") {
+            value = &settings.samples_per_pixel;
+        } else {
+            return false;
+        }
+
+        if (!tokenizer.integer(*value) || *value <= 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool parse_geometry(Tokenizer& tokenizer, Definitions<Geometry>& geometries) {
+    std::string_view name;
+    std::string_view type;
+    if (!tokenizer.token(name) || !tokenizer.token(type)) {
+        return false;
+    }
+
+    if (type == "box") {
+        float3 half_size;
+        if (!tokenizer.number(half_size) || half_size.x <= 0.0 || half_size.y <= 0.0 || half_size.z <= 0.0) {
+            return false;
+        }
+        return geometries.add(name, 'b', half_size.begin(), 3, [&] { return std::make_shared<BoxGeometry>(half_size); });
+    }
+
+    if (type == "sphere") {
+        double radius;
+        if (!tokenizer.number(radius) || radius <= 0.0) {
+            return false;
+        }
+        return geometries.add(name, 's', &radius, 1, [&] { return std::make_shared<SphereGeometry>(radius); });
+    }
+
+    return false;
+}
+
+static bool parse_material(Tokenizer& tokenizer, Definitions<Material>& materials) {
+    std::string_view name;
+    std::string_view type;
+    if (!tokenizer.token(name) || !tokenizer.token(type)) {
+        return false;
+    }
+
+    if (type == "diffuse" || type == "emissive") {
+        float3 color;
+        if (!tokenizer.number(color) || color.x < 0.0 || color.y < 0.0 || color.z < 0.0) {
+            return false;
+        }
+
+        if (type == "diffuse") {
+            return materials.add(name, 'd', color.begin(), 3, [&] { return std::make_shared<DiffuseMaterial>(color); });
+        }
+        return materials.add(name, 'e', color.begin(), 3, [&] { return std::make_shared<EmissiveMaterial>(color); });
+    }
+
+    if (type == "reflective" || type == "transmissive") {
+        double ior;
+        if (!tokenizer.number(ior) || ior <= 0.0) {
+            return false;
+        }
+
+        if (type == "reflective") {
+            return materials.add(name, 'r', &ior, 1, [&] { return std::make_shared<SpecularReflectiveMaterial>(ior); });
+        }
+        return materials.add(name, 't', &ior, 1, [&] { return std::make_shared<SpecularTransmissiveMaterial>(ior); });
+    }
+
+    return false;
+}
+
+static bool parse_primitive(Tokenizer& tokenizer, const Definitions<Geometry>& geometries, const Definitions<Material>& materials, SceneFile& result) {
+    std::string_view geometry_name;
+    std::string_view material_name;
+    if (!tokenizer.token(geometry_name) || !tokenizer.token(material_name)) {
+        return false;
+    }
+
+    int geometry = geometries.find(geometry_name);
+    int material = materials.find(material_name);
+    if (geometry < 0 || material < 0) {
+        return false;
+    }
+
+    float4x4 transform;
+
+    std::string_view keyword;
+    while (tokenizer.token(keyword)) {
+        if (keyword == "translate") {
+            float3 translation;
+            if (!tokenizer.number(translation)) {
+                return false;
+            }
+            transform = transform * float4x4::translation(translation);
+        } else if (keyword == "rotate") {
+            float3 axis;
+            double angle;
+            if (!tokenizer.number(axis) || !tokenizer.number(angle) || equal(axis, 0.0)) {
+                return false;
+            }
+            transform = transform * float4x4::rotation(normalize(axis), radians(angle));
+        } else {
+            return false;
+        }
+    }
+
+    result.primitives.emplace_back(geometries.object(geometry), materials.object(material), transform);
+    result.sources.push_back(PrimitiveSource{ geometry, material, transform });
+    return true;
+}
+
+bool load_scene_file(const std::string& path, SceneFile& result, std::string& error) {
+    TraceScope trace_scope("load scene file");
+
+    auto read_start = std::chrono::steady_clock::now();
+
+    std::ifstream stream(path, std::ios::binary | std::ios::ate);
+    if (!stream) {
+        error = "Failed to open " + path;
+        return false;
+    }
+
+    std::string contents(static_cast<size_t>(stream.tellg()), '\0');
+    stream.seekg(0);
+    if (!stream.read(contents.data(), contents.size())) {
+        error = "Failed to read " + path;
+        return false;
+    }
+
+    auto parse_start = std::chrono::steady_clock::now();
+
+    result = SceneFile();
+
+    // Primitives are large, growing the vector would copy them several times. Every line holds at most one of them.
+    size_t line_count = std::count(contents.begin(), contents.end(), '\n') + 1;
+    result.primitives.reserve(line_count);
+    result.sources.reserve(line_count);
+
+    Definitions<Geometry> geometries;
+    Definitions<Material> materials;
+
+    Tokenizer tokenizer(contents.data(), contents.data() + contents.size());
+    while (tokenizer.next_line()) {
+        std::string_view statement;
+        tokenizer.token(statement);
+
+        bool is_valid;
+        if (statement == "primitive") {
+            is_valid = parse_primitive(tokenizer, geometries, materials, result);
+        } else if (statement == "geometry") {
+            is_valid = parse_geometry(tokenizer, geometries);
+        } else if (statement == "material") {
+            is_valid = parse_material(tokenizer, materials);
+        } else if (statement == "camera") {
+            is_valid = parse_camera(tokenizer, result.settings);
+        } else if (statement == "settings") {
+            is_valid = parse_settings(tokenizer, result.settings);
+        } else {
+            is_valid = false;
+        }
+
+        if (!is_valid || !tokenizer.is_line_end()) {
+            error = path + ":" + std::to_string(tokenizer.line()) + ": invalid " + std::string(statement) + " statement";
+            return false;
+        }
+    }
+
+    result.geometry_keys = std::move(geometries.keys());
+    result.material_keys = std::move(materials.keys());
+
+    auto parse_end = std::chrono::steady_clock::now();
+    result.read_seconds = std::chrono::duration<double>(parse_start - read_start).count();
+    result.parse_seconds = std::chrono::duration<double>(parse_end - parse_start).count();
+
+    return true;
+}
+
+bool SceneFileDiff::is_empty() const {
+    return !is_rebuilt && changed_primitives.empty() && !is_camera_changed;
+}
+
+SceneFileDiff diff_scene_files(const SceneFile& live, const SceneFile& edited) {
+    SceneFileDiff result;
+
+    const SceneFileSettings& live_settings = live.settings;
+    const SceneFileSettings& edited_settings = edited.settings;
+    result.is_camera_changed = live_settings.camera_position != edited_settings.camera_position || live_settings.camera_yaw != edited_settings.camera_yaw ||
+        live_settings.camera_pitch != edited_settings.camera_pitch || live_settings.camera_fov != edited_settings.camera_fov;
+    result.is_image_changed = live_settings.width != edited_settings.width || live_settings.height != edited_settings.height ||
+        live_settings.samples_per_pixel != edited_settings.samples_per_pixel;
+
+    if (live.sources.size() != edited.sources.size()) {
+        result.is_rebuilt = true;
+        return result;
+    }
+
+    for (size_t i = 0; i < edited.sources.size(); i++) {
+        const PrimitiveSource& live_source = live.sources[i];
+        const PrimitiveSource& edited_source = edited.sources[i];
+
+        if (live.geometry_keys[live_source.geometry] != edited.geometry_keys[edited_source.geometry]) {
+            result.is_rebuilt = true;
+            result.changed_primitives.clear();
+            return result;
+        }
+
+        if (live.material_keys[live_source.material] != edited.material_keys[edited_source.material] || live_source.transform != edited_source.transform) {
+            result.changed_primitives.push_back(i);
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "maths.h"
+#include "primitive.h"
+
+#include <string>
+#include <vector>
+
+// Camera and render settings of a scene file. Render settings the file doesn't give are zero.
+struct SceneFileSettings {
+    float3 camera_position = float3(0.0);
+
+    // In radians, see `Camera`.
+    double camera_yaw = 0.0;
+    double camera_pitch = 0.0;
+    double camera_fov = radians(30.0);
+
+    int width = 0;
+    int height = 0;
+    int samples_per_pixel = 0;
+};
+
+// What a primitive was made of, indices are into the keys of `SceneFile`.
+struct PrimitiveSource {
+    int geometry;
+    int material;
+    float4x4 transform;
+};
+
+struct SceneFile {
+    std::vector<Primitive> primitives;
+    SceneFileSettings settings;
+
+    // Distinct geometries and materials, after identical definitions are merged. Keys are the type and the bits of the
+    // parameters, so they can be compared between two loads of a file.
+    std::vector<std::string> geometry_keys;
+    std::vector<std::string> material_keys;
+
+    // One per primitive, kept after the primitives are moved out to tell what an edit of the file changed.
+    std::vector<PrimitiveSource> sources;
+
+    double read_seconds = 0.0;
+    double parse_seconds = 0.0;
+};
+
+// Loads a scene in the text format below, in a single pass over the file. Returns false with a message that names the
+// line if the file can't be read or is malformed.
+//
+// Every line is a statement, `#` starts a comment. Angles are in degrees.
+//
+//     camera position <x> <y> <z> yaw <angle> pitch <angle> fov <angle>
+//     settings width <pixels> height <pixels> spp <samples>
+//     geometry <name> box <half width> <half height> <half depth>
+//     geometry <name> sphere <radius>
+//     material <name> diffuse <r> <g> <b>
+//     material <name> emissive <r> <g> <b>
+//     material <name> reflective <ior>
+//     material <name> transmissive <ior>
+//     primitive <geometry> <material> [translate <x> <y> <z>] [rotate <axis x> <axis y> <axis z> <angle>]...
+//
+// Keywords of `camera` and `settings` are optional and may come in any order. Geometries and materials must be
+// defined before the primitives that use them, primitives with the same definitions share them whatever their names.
+// Transforms of a primitive are applied in the order they're written.
+bool load_scene_file(const std::string& path, SceneFile& result, std::string& error);
+
+// How to turn the scene loaded from one version of a file into the scene loaded from another.
+struct SceneFileDiff {
+    // Primitives were added, removed or changed their geometry, the whole scene is replaced.
+    bool is_rebuilt = false;
+
+    // Primitives whose material or transform changed, they are replaced in place. Empty if the scene is rebuilt.
+    std::vector<size_t> changed_primitives;
+
+    bool is_camera_changed = false;
+
+    // Width, height or samples per pixel changed, which can't be applied to a live render.
+    bool is_image_changed = false;
+
+    // True if there's nothing to apply to a live render.
+    bool is_empty() const;
+};
+
+// Primitives are matched by their order in the files. `live` may have had its primitives moved out.
+SceneFileDiff diff_scene_files(const SceneFile& live, const SceneFile& edited);
@@ -0,0 +1,245 @@
+#include "tone_mapping.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstring>
+#include <iterator>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TONE_MAPPING_SSE2
+#include <emmintrin.h>
+#endif
+
+// Values are clamped to [2^-13, 1) and the table is indexed by the float bits: the octave of the value followed by the
+// top SRGB_MANTISSA_BITS of its mantissa. Everything below 2^-13 is encoded as 0 anyway.
+static constexpr int SRGB_OCTAVES = 13;
+static constexpr int SRGB_MANTISSA_BITS = 10;
+static constexpr int SRGB_SHIFT = 23 - SRGB_MANTISSA_BITS;
+static constexpr uint32_t SRGB_MIN_BITS = (127 - SRGB_OCTAVES) << 23;
+static constexpr uint32_t SRGB_MAX_BITS = 0x3F7FFFFF;
+
+static float bits_to_float(uint32_t bits) {
+    float result;
+    std::memcpy(&result, &bits, sizeof(float));
+    return result;
+}
+
+static uint32_t float_to_bits(float value) {
+    uint32_t result;
+    std::memcpy(&result, &value, sizeof(float));
+    return result;
+}
+
+static double gamma_correct(double value) {
+    if (value <= 0.0031308) {
+        return 12.92 * value;
+    }
+
+    return 1.055 * std::pow(value, 1.0 / 2.4) - 0.055;
+}
+
+static std::array<uint8_t, SRGB_OCTAVES << SRGB_MANTISSA_BITS> build_srgb_table() {
+    std::array<uint8_t, SRGB_OCTAVES << SRGB_MANTISSA_BITS> result;
+
+    for (uint32_t i = 0; i < result.size(); i++) {
+        double from = bits_to_float(SRGB_MIN_BITS + (i << SRGB_SHIFT));
+        double to = bits_to_float(SRGB_MIN_BITS + ((i + 1) << SRGB_SHIFT));
+
+        result[i] = static_cast<uint8_t>(clamp(gamma_correct((from + to) * 0.5), 0.0, 1.0) * 255.0 + 0.5);
+    }
+
+    return result;
+}
+
+static const std::array<uint8_t, SRGB_OCTAVES << SRGB_MANTISSA_BITS> SRGB_TABLE = build_srgb_table();
+
+static uint32_t pack(uint32_t index_r, uint32_t index_g, uint32_t index_b) {
+    assert(index_r < SRGB_TABLE.size() && index_g < SRGB_TABLE.size() && index_b < SRGB_TABLE.size());
+
+    return (uint32_t(SRGB_TABLE[index_r]) << 24) | (uint32_t(SRGB_TABLE[index_g]) << 16) | (uint32_t(SRGB_TABLE[index_b]) << 8) | 0xFF;
+}
+
+template <ToneMappingOperator Operator>
+static float apply_operator(float value) {
+    if constexpr (Operator == ToneMappingOperator::REINHARD) {
+        return value / (1.0f + value);
+    } else if constexpr (Operator == ToneMappingOperator::ACES) {
+        // Narkowicz's fit of the ACES filmic curve.
+        return value * (2.51f * value + 0.03f) / (value * (2.43f * value + 0.59f) + 0.14f);
+    } else {
+        return value;
+    }
+}
+
+static uint32_t encode(float value) {
+    float min = bits_to_float(SRGB_MIN_BITS);
+    float max = bits_to_float(SRGB_MAX_BITS);
+
+    // Same operand order as `_mm_max_ps` and `_mm_min_ps`.
+    value = value > min ? value : min;
+    value = value < max ? value : max;
+
+    return (float_to_bits(value) - SRGB_MIN_BITS) >> SRGB_SHIFT;
+}
+
+#ifdef TONE_MAPPING_SSE2
+template <ToneMappingOperator Operator>
+static __m128 apply_operator(__m128 value) {
+    if constexpr (Operator == ToneMappingOperator::REINHARD) {
+        return _mm_div_ps(value, _mm_add_ps(_mm_set1_ps(1.0f), value));
+    } else if constexpr (Operator == ToneMappingOperator::ACES) {
+        __m128 numerator = _mm_mul_ps(value, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.51f), value), _mm_set1_ps(0.03f)));
+        __m128 denominator = _mm_add_ps(_mm_mul_ps(value, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.43f), value), _mm_set1_ps(0.59f))), _mm_set1_ps(0.14f));
+        return _mm_div_ps(numerator, denominator);
+    } else {
+        return value;
+    }
+}
+
+static __m128i encode(__m128 value) {
+    value = _mm_max_ps(value, _mm_set1_ps(bits_to_float(SRGB_MIN_BITS)));
+    value = _mm_min_ps(value, _mm_set1_ps(bits_to_float(SRGB_MAX_BITS)));
+
+    __m128i bits = _mm_sub_epi32(_mm_castps_si128(value), _mm_set1_epi32(SRGB_MIN_BITS));
+    return _mm_srli_epi32(bits, SRGB_SHIFT);
+}
+
+// Per pixel scales of four pixels, the exposure divided by the sample count, or zero for pixels without samples.
+static __m128 pixel_scales(__m128i counts, __m128 exposure) {
+    __m128 inverse = _mm_div_ps(_mm_set1_ps(1.0f), _mm_cvtepi32_ps(counts));
+    __m128 has_samples = _mm_castsi128_ps(_mm_cmpgt_epi32(counts, _mm_setzero_si128()));
+    return _mm_mul_ps(_mm_and_ps(inverse, has_samples), exposure);
+}
+#endif
+
+static float pixel_scale(const uint32_t* sample_counts, int index, float exposure) {
+    if (sample_counts == nullptr) {
+        return exposure;
+    }
+
+    float inverse = sample_counts[index] > 0 ? 1.0f / static_cast<float>(sample_counts[index]) : 0.0f;
+    return inverse * exposure;
+}
+
+template <ToneMappingOperator Operator>
+static void tone_map(float exposure, const float* rgb, const uint32_t* sample_counts, int count, uint32_t* rgba) {
+    int i = 0;
+
+#ifdef TONE_MAPPING_SSE2
+    __m128 exposure4 = _mm_set1_ps(exposure);
+
+    __m128 scales = sample_counts != nullptr ? _mm_setzero_ps() : exposure4;
+    __m128i scaled_counts = _mm_setzero_si128();
+
+    for (; i + 4 <= count; i += 4) {
+        const float* values = rgb + i * 3;
+
+        if (sample_counts != nullptr) {
+            // Pixels of a tile usually share their sample count, so the division is skipped while the counts repeat.
+            __m128i counts = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sample_counts + i));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi32(counts, scaled_counts)) != 0xFFFF) {
+                scales = pixel_scales(counts, exposure4);
+                scaled_counts = counts;
+            }
+        }
+
+        // Channels are processed independently, so the interleaved pixels are only matched with their scales:
+        // r0 g0 b0 r1 | g1 b1 r2 g2 | b2 r3 g3 b3.
+        __m128 scales0 = _mm_shuffle_ps(scales, scales, _MM_SHUFFLE(1, 0, 0, 0));
+        __m128 scales1 = _mm_shuffle_ps(scales, scales, _MM_SHUFFLE(2, 2, 1, 1));
+        __m128 scales2 = _mm_shuffle_ps(scales, scales, _MM_SHUFFLE(3, 3, 3, 2));
+
+        alignas(16) uint32_t indices[12];
+        _mm_store_si128(reinterpret_cast<__m128i*>(indices + 0), encode(apply_operator<Operator>(_mm_mul_ps(_mm_loadu_ps(values + 0), scales0))));
+        _mm_store_si128(reinterpret_cast<__m128i*>(indices + 4), encode(apply_operator<Operator>(_mm_mul_ps(_mm_loadu_ps(values + 4), scales1))));
+        _mm_store_si128(reinterpret_cast<__m128i*>(indices + 8), encode(apply_operator<Operator>(_mm_mul_ps(_mm_loadu_ps(values + 8), scales2))));
+
+        rgba[i + 0] = pack(indices[0], indices[1], indices[2]);
+        rgba[i + 1] = pack(indices[3], indices[4], indices[5]);
+        rgba[i + 2] = pack(indices[6], indices[7], indices[8]);
+        rgba[i + 3] = pack(indices[9], indices[10], indices[11]);
+    }
+#endif
+
+    for (; i < count; i++) {
+        float scale = pixel_scale(sample_counts, i, exposure);
+
+        uint32_t index_r = encode(apply_operator<Operator>(rgb[i * 3 + 0] * scale));
+        uint32_t index_g = encode(apply_operator<Operator>(rgb[i * 3 + 1] * scale));
+        uint32_t index_b = encode(apply_operator<Operator>(rgb[i * 3 + 2] * scale));
+
+        rgba[i] = pack(index_r, index_g, index_b);
+    }
+}
+
+void tone_map(const ToneMapping& tone_mapping, const float* rgb, const uint32_t* sample_counts, int count, uint32_t* rgba) {
+    assert(std::isfinite(tone_mapping.exposure));
+    assert(rgb != nullptr);
+    assert(count >= 0);
+    assert(rgba != nullptr);
+
+    auto exposure = static_cast<float>(std::exp2(tone_mapping.exposure));
+
+    switch (tone_mapping.tone_operator) {
+        case ToneMappingOperator::CLAMP:
+            tone_map<ToneMappingOperator::CLAMP>(exposure, rgb, sample_counts, count, rgba);
+            break;
+        case ToneMappingOperator::REINHARD:
+            tone_map<ToneMappingOperator::REINHARD>(exposure, rgb, sample_counts, count, rgba);
+            break;
+        case ToneMappingOperator::ACES:
+            tone_map<ToneMappingOperator::ACES>(exposure, rgb, sample_counts, count, rgba);
+            break;
+        default:
+            assert(false);
+            break;
+    }
+}
+
+void heatmap(const float* values, int count, float max_value, uint32_t* rgba) {
+    assert(values != nullptr);
+    assert(count >= 0);
+    assert(max_value >= 0.0f);
+    assert(rgba != nullptr);
+
+    // Dark blue, blue, cyan, green, yellow and red at equal steps, already sRGB encoded.
+    static constexpr float STOPS[][3] = {
+        { 0.0f, 0.0f, 0.2f },
+        { 0.0f, 0.2f, 1.0f },
+        { 0.0f, 0.9f, 1.0f },
+        { 0.2f, 1.0f, 0.2f },
+        { 1.0f, 0.9f, 0.0f },
+        { 1.0f, 0.1f, 0.0f },
+    };
+    constexpr int STOP_COUNT = static_cast<int>(std::size(STOPS));
+
+    for (int i = 0; i < count; i++) {
+        assert(values[i] >= 0.0f);
+
+        // A film without costs yet, after a restart or a resume, has a maximum of zero.
+        float position = max_value > 0.0f ? std::min(values[i] / max_value, 1.0f) * (STOP_COUNT - 1) : 0.0f;
+        int stop = std::min(static_cast<int>(position), STOP_COUNT - 2);
+        float t = position - stop;
+
+        uint32_t pixel = 0xFF;
+        for (int j = 0; j < 3; j++) {
+            float value = STOPS[stop][j] + (STOPS[stop + 1][j] - STOPS[stop][j]) * t;
+            pixel |= static_cast<uint32_t>(value * 255.0f + 0.5f) << (24 - j * 8);
+        }
+        rgba[i] = pixel;
+    }
+}
+
+float percentile(const float* values, int count, double percentile) {
+    assert(values != nullptr);
+    assert(count > 0);
+    assert(percentile >= 0.0 && percentile <= 100.0);
+
+    std::vector<float> sorted(values, values + count);
+
+    auto nth = sorted.begin() + std::min(static_cast<int>(count * percentile / 100.0), count - 1);
+    std::nth_element(sorted.begin(), nth, sorted.end());
+    return *nth;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "maths.h"
+
+#include <cstdint>
+
+enum class ToneMappingOperator {
+    CLAMP,
+    REINHARD,
+    ACES,
+    COUNT,
+};
+
+struct ToneMapping {
+    // In stops, radiance is multiplied by `2^exposure` before the operator is applied.
+    double exposure = 0.0;
+    ToneMappingOperator tone_operator = ToneMappingOperator::CLAMP;
+};
+
+// Converts `count` interleaved RGB radiance sums divided by their `sample_counts` into sRGB encoded RGBA8888 pixels,
+// pixels without samples become black. Radiance isn't divided when `sample_counts` is null. Radiance is tone mapped in
+// single precision and encoded through a lookup table indexed by the float bits, four pixels at a time when SSE2 is
+// available. Both paths produce the same pixels.
+void tone_map(const ToneMapping& tone_mapping, const float* rgb, const uint32_t* sample_counts, int count, uint32_t* rgba);
+
+// Converts `count` non-negative values into RGBA8888 pixels of a false color scale from dark blue for zero to red for
+// `max_value` and above. Everything is dark blue if `max_value` is zero.
+void heatmap(const float* values, int count, float max_value, uint32_t* rgba);
+
+// Value at the given percentile, a more robust maximum for `heatmap` than the actual maximum.
+float percentile(const float* values, int count, double percentile);
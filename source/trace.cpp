@@ -0,0 +1,147 @@
+#include "trace.h"
+
+#include <cassert>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct TraceEvent {
+    const char* name;
+    uint64_t begin;
+    uint64_t end;
+    int tile_x;
+    int tile_y;
+    int pass;
+};
+
+// Written only by its thread. `head` counts all the events ever recorded, the last `capacity` of them are kept.
+struct TraceBuffer {
+    int thread_id;
+    std::string thread_name;
+    std::unique_ptr<TraceEvent[]> events;
+    size_t capacity;
+    std::atomic<uint64_t> head{ 0 };
+};
+
+// Buffers are never freed, a thread keeps its buffer across traces.
+static std::mutex g_mutex;
+static std::vector<std::unique_ptr<TraceBuffer>> g_buffers;
+static size_t g_events_per_thread = Trace::DEFAULT_EVENTS_PER_THREAD;
+static uint64_t g_start;
+
+static thread_local TraceBuffer* t_buffer = nullptr;
+
+static TraceBuffer& thread_buffer() {
+    if (t_buffer == nullptr) {
+        std::lock_guard<std::mutex> lock(g_mutex);
+
+        auto buffer = std::make_unique<TraceBuffer>();
+        assert(buffer != nullptr);
+
+        buffer->thread_id = static_cast<int>(g_buffers.size()) + 1;
+        buffer->thread_name = "Thread " + std::to_string(buffer->thread_id);
+        buffer->events = std::make_unique<TraceEvent[]>(g_events_per_thread);
+        buffer->capacity = g_events_per_thread;
+
+        t_buffer = buffer.get();
+        g_buffers.push_back(std::move(buffer));
+    }
+
+    return *t_buffer;
+}
+
+void Trace::start(size_t events_per_thread) {
+    assert(events_per_thread > 0);
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+
+    for (const std::unique_ptr<TraceBuffer>& buffer : g_buffers) {
+        if (buffer->capacity != events_per_thread) {
+            buffer->events = std::make_unique<TraceEvent[]>(events_per_thread);
+            buffer->capacity = events_per_thread;
+        }
+        buffer->head.store(0, std::memory_order_relaxed);
+    }
+
+    g_events_per_thread = events_per_thread;
+    g_start = now();
+
+    s_is_enabled.store(true, std::memory_order_release);
+}
+
+static void write_string(std::ofstream& stream, const std::string& value) {
+    stream << '"';
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            stream << '\\';
+        }
+        stream << c;
+    }
+    stream << '"';
+}
+
+bool Trace::write(const std::string& path) {
+    s_is_enabled.store(false, std::memory_order_relaxed);
+
+    std::ofstream stream(path);
+    if (!stream) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+
+    stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+    bool is_first = true;
+    for (const std::unique_ptr<TraceBuffer>& buffer : g_buffers) {
+        stream << (is_first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->thread_id << ",\"args\":{\"name\":";
+        write_string(stream, buffer->thread_name);
+        stream << "}}";
+        is_first = false;
+
+        uint64_t head = buffer->head.load(std::memory_order_acquire);
+        uint64_t first = head > buffer->capacity ? head - buffer->capacity : 0;
+
+        for (uint64_t i = first; i < head; i++) {
+            const TraceEvent& event = buffer->events[i % buffer->capacity];
+
+            // Complete events with microsecond timestamps.
+            stream << ",\n{\"name\":";
+            write_string(stream, event.name);
+            stream << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->thread_id << ",\"ts\":" << (event.begin - g_start) * 1e-3 << ",\"dur\":" << (event.end - event.begin) * 1e-3;
+            if (event.tile_x >= 0) {
+                stream << ",\"args\":{\"tile_x\":" << event.tile_x << ",\"tile_y\":" << event.tile_y << ",\"pass\":" << event.pass << "}";
+            }
+            stream << "}";
+        }
+    }
+
+    stream << "\n]}\n";
+
+    return static_cast<bool>(stream);
+}
+
+void Trace::set_thread_name(const std::string& name) {
+    if (!is_enabled()) {
+        return;
+    }
+
+    TraceBuffer& buffer = thread_buffer();
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+    buffer.thread_name = name;
+}
+
+uint64_t Trace::now() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void Trace::record(const char* name, uint64_t begin, uint64_t end, int tile_x, int tile_y, int pass) {
+    TraceBuffer& buffer = thread_buffer();
+
+    uint64_t head = buffer.head.load(std::memory_order_relaxed);
+    buffer.events[head % buffer.capacity] = TraceEvent{ name, begin, end, tile_x, tile_y, pass };
+    buffer.head.store(head + 1, std::memory_order_release);
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Timeline of what every thread was doing, written in the Chrome trace event format (chrome://tracing, Perfetto).
+// Every thread records into its own ring buffer, so recording takes no locks and a buffer that is full drops its oldest
+// events. While tracing is disabled, a TraceScope costs a single relaxed load.
+class Trace {
+public:
+    static constexpr size_t DEFAULT_EVENTS_PER_THREAD = 1 << 16;
+
+    // Clears the events recorded so far and starts recording.
+    static void start(size_t events_per_thread = DEFAULT_EVENTS_PER_THREAD);
+
+    // Stops recording and writes the events. Threads should not be recording at the same time, the events they record
+    // in the meantime may be torn. Returns false if the file can't be written.
+    static bool write(const std::string& path);
+
+    static bool is_enabled() {
+        return s_is_enabled.load(std::memory_order_relaxed);
+    }
+
+    // Names the calling thread in the trace.
+    static void set_thread_name(const std::string& name);
+
+private:
+    friend class TraceScope;
+
+    static uint64_t now();
+
+    // Tile arguments are negative for events that aren't about a tile.
+    static void record(const char* name, uint64_t begin, uint64_t end, int tile_x, int tile_y, int pass);
+
+    static inline std::atomic<bool> s_is_enabled{ false };
+};
+
+// Records an event from its construction to its destruction. `name` must outlive the trace.
+class TraceScope {
+public:
+    explicit TraceScope(const char* name)
+        : TraceScope(name, -1, -1, -1)
+    {
+    }
+
+    TraceScope(const char* name, int tile_x, int tile_y, int pass)
+        : m_name(Trace::is_enabled() ? name : nullptr)
+        , m_begin(m_name != nullptr ? Trace::now() : 0)
+        , m_tile_x(tile_x)
+        , m_tile_y(tile_y)
+        , m_pass(pass)
+    {
+    }
+
+    ~TraceScope() {
+        if (m_name != nullptr) {
+            Trace::record(m_name, m_begin, Trace::now(), m_tile_x, m_tile_y, m_pass);
+        }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* m_name;
+    uint64_t m_begin;
+    int m_tile_x;
+    int m_tile_y;
+    int m_pass;
+};
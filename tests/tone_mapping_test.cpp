@@ -0,0 +1,30 @@
+#include "tone_mapping.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// Heatmap of a film without costs, such as right after a restart or after resuming from a checkpoint.
+static bool test_heatmap_all_zero() {
+    constexpr int COUNT = 64;
+
+    std::vector<float> costs(COUNT, 0.0f);
+    std::vector<uint32_t> rgba(COUNT, 0);
+
+    float max_value = percentile(costs.data(), COUNT, 99.0);
+    heatmap(costs.data(), COUNT, max_value, rgba.data());
+
+    // Dark blue, the first stop of the scale.
+    for (uint32_t pixel : rgba) {
+        if (pixel != 0x000033FF) {
+            std::fprintf(stderr, "heatmap of zero costs: expected 0x000033FF, got 0x%08X\n", pixel);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main() {
+    bool is_passed = test_heatmap_all_zero();
+    return is_passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}